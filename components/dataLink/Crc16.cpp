@@ -0,0 +1,77 @@
+#include "DataLinkManager.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_rom_crc.h"
+#endif
+
+/**
+ * @brief Slice-by-8 lookup tables. `tables[0]` is the usual byte at a time table, and `tables[k]` the CRC of a byte
+ * followed by k zero bytes, so 8 bytes are folded in with 8 independent lookups
+ *
+ */
+typedef struct {
+    uint16_t tables[CRC16_SLICE_BYTES][256];
+} crc16_slice_tables_t;
+
+static constexpr crc16_slice_tables_t make_crc16_slice_tables(){
+    crc16_slice_tables_t slices = {};
+    for (uint16_t byte = 0; byte < 256; byte++){
+        uint16_t crc = byte << 8;
+        for (uint8_t bit = 0; bit < 8; bit++){
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ CRC_POLYNOMIAL) : (uint16_t)(crc << 1);
+        }
+        slices.tables[0][byte] = crc;
+    }
+
+    for (uint8_t k = 1; k < CRC16_SLICE_BYTES; k++){
+        for (uint16_t byte = 0; byte < 256; byte++){
+            uint16_t prev = slices.tables[k - 1][byte];
+            slices.tables[k][byte] = (uint16_t)(prev << 8) ^ slices.tables[0][prev >> 8];
+        }
+    }
+    return slices;
+}
+
+static constexpr crc16_slice_tables_t crc16_slices = make_crc16_slice_tables();
+
+/**
+ * @brief Byte at a time reference
+ *
+ */
+uint16_t crc16_update_bytewise(uint16_t crc, const uint8_t* data, size_t data_len){
+    for (size_t i = 0; i < data_len; i++){
+        crc = (uint16_t)(crc << 8) ^ crc16_slices.tables[0][(crc >> 8) ^ data[i]];
+    }
+    return crc;
+}
+
+uint16_t crc16_update_slice8(uint16_t crc, const uint8_t* data, size_t data_len){
+    const uint16_t (*t)[256] = crc16_slices.tables;
+
+    while (data_len >= CRC16_SLICE_BYTES){
+        crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xFF)] ^ t[5][data[2]] ^ t[4][data[3]]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += CRC16_SLICE_BYTES;
+        data_len -= CRC16_SLICE_BYTES;
+    }
+
+    return crc16_update_bytewise(crc, data, data_len);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief `esp_rom_crc16_be` inverts the CRC on the way in and out, so the inversions are undone to keep `CRC16_INIT`
+ * and incremental updates the same as the software engines
+ *
+ */
+uint16_t crc16_update_rom(uint16_t crc, const uint8_t* data, size_t data_len){
+    return (uint16_t)~esp_rom_crc16_be((uint16_t)~crc, data, data_len);
+}
+#endif
+
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t data_len){
+#if CRC16_USE_ROM && !CONFIG_IDF_TARGET_LINUX
+    return crc16_update_rom(crc, data, data_len);
+#else
+    return crc16_update_slice8(crc, data, data_len);
+#endif
+}
@@ -1,26 +1,9 @@
 #include "DataLinkManager.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <cstring>
 #include <type_traits>
 
-/**
- * @brief Creates a Control Frame from `FrameHeader`
- *
- * @param header
- * @return ControlFrame
- */
-ControlFrame make_control_frame_from_header(const FrameHeader& header) {
-    ControlFrame frame{};
-    frame.preamble = header.preamble;
-    frame.sender_id = header.sender_id;
-    frame.receiver_id = header.receiver_id;
-    frame.seq_num = header.seq_num;
-    frame.type_flag = header.type_flag;
-    frame.data_len = header.data_len;
-    frame.crc_16 = header.crc_16;
-    return frame;
-}
-
 /**
  * @brief Creates a Generic Frame from `FrameHeader`
  *
@@ -42,183 +25,158 @@ GenericFrame make_generic_frame_from_header(const FrameHeader& header) {
 }
 
 /**
- * @brief Store a fragment that has been received
+ * @brief Serializes a frame (header from `header`, `data_len` bytes of `data`, then the CRC) in one pass into `buf`,
+ * typically the PHY TX slot the frame is sent from. The layout (control or generic) follows `header.type_flag`
  *
- * @param fragment
- * @param channel
- * @return esp_err_t
+ * @param header Header of the frame (`data_len` and `crc_16` are ignored)
+ * @param data Payload (may be a slice of a larger buffer, eg. one fragment)
+ * @param data_len
+ * @param buf
+ * @param capacity Bytes available in `buf`
+ * @param frame_size Bytes written to `buf` (will be written)
+ * @return esp_err_t `ESP_ERR_INVALID_SIZE` if the frame does not fit in `capacity` or `MAX_FRAME_SIZE`
  */
-esp_err_t DataLinkManager::store_fragment(GenericFrame* fragment, uint8_t channel){
-    if (fragment == nullptr){
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (fragment->data_len == 0){
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (fragment->receiver_id != this_board_id){
+esp_err_t write_frame(const FrameHeader& header, const uint8_t* data, uint16_t data_len, uint8_t* buf, size_t capacity, size_t* frame_size){
+    if ((data == nullptr && data_len > 0) || buf == nullptr || frame_size == nullptr){
         return ESP_ERR_INVALID_ARG;
     }
 
-    // ESP_LOGI(DEBUG_LINK_TAG, "got frame %d, fragment %d of %d", fragment->seq_num, fragment->frag_num, fragment->total_frag);
-
-    if (rx_fragment_mutex[channel] == NULL){
-        return ESP_FAIL;
-    }
-
-    if (xSemaphoreTake(rx_fragment_mutex[channel], pdMS_TO_TICKS(ASYNC_QUEUE_WAIT_TICKS)) != pdTRUE){
-        return ESP_ERR_TIMEOUT;
-    }
-
-    if (fragment_map[channel][fragment->receiver_id].find(fragment->seq_num) == fragment_map[channel][fragment->receiver_id].end()){
-        FragmentMetadata& metadata = fragment_map[channel][fragment->receiver_id][fragment->seq_num];
-        metadata.num_fragments_rx = 0;
-
-        metadata.fragments.reserve(fragment->total_frag);
-        for (uint16_t i = 0; i < fragment->total_frag; i++){
-            metadata.fragments.push_back(GenericFrame{});
-        }
-    }
-
-    FragmentMetadata& metadata = fragment_map[channel][fragment->receiver_id][fragment->seq_num];
-    if ((fragment->frag_num-1) > metadata.fragments.size()){
-        xSemaphoreGive(rx_fragment_mutex[channel]);
-        return ESP_ERR_INVALID_STATE;
+    bool is_control_frame = IS_CONTROL_FRAME(header.type_flag);
+    size_t header_size = is_control_frame ? CONTROL_FRAME_HEADER_SIZE : GENERIC_FRAME_HEADER_SIZE;
+    size_t size = header_size + data_len + FRAME_CRC_SIZE;
+    if (size > capacity || size > MAX_FRAME_SIZE){
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    if (metadata.fragments[fragment->frag_num-1].data_len == 0){
-        metadata.fragments[fragment->frag_num-1] = *fragment;
-        metadata.num_fragments_rx++;
-        // ESP_LOGI(DEBUG_LINK_TAG, "store frame %d fragment %d success; got %d out of %d", fragment->seq_num, fragment->frag_num, metadata.num_fragments_rx, metadata.fragments.size());
+    size_t offset = 0;
+    buf[offset++] = header.preamble;
+    buf[offset++] = header.sender_id;
+    buf[offset++] = header.receiver_id;
+    buf[offset++] = header.seq_num & 0xFF;
+    buf[offset++] = (header.seq_num >> 8) & 0xFF;
+    buf[offset++] = header.type_flag;
+    if (!is_control_frame){
+        buf[offset++] = (header.frag_info >> 16) & 0xFF; //total_frag
+        buf[offset++] = (header.frag_info >> 24) & 0xFF;
+        buf[offset++] = header.frag_info & 0xFF; //frag_num
+        buf[offset++] = (header.frag_info >> 8) & 0xFF;
     }
+    buf[offset++] = data_len & 0xFF;
+    buf[offset++] = (data_len >> 8) & 0xFF;
 
-    uint16_t last_consec_rx_frag = 0;
-    if (static_cast<FrameType>(GET_TYPE(fragment->type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE){
-        for (; last_consec_rx_frag < fragment->total_frag; last_consec_rx_frag++){
-            if (metadata.fragments[last_consec_rx_frag].data_len == 0){
-                //found missing fragment
-                break;
-            }
-        }
+    if (data_len > 0){
+        memcpy(&buf[offset], data, data_len);
     }
+    offset += data_len;
 
-    size_t metadata_fragment_size = metadata.fragments.size();
-    xSemaphoreGive(rx_fragment_mutex[channel]);
-
-    if (static_cast<FrameType>(GET_TYPE(fragment->type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE){
-        SendAckMetaData data = {
-            .data = {GENERIC_FRAG_ACK_PREAMBLE, static_cast<uint8_t>((last_consec_rx_frag & 0xFF00) >> 8), static_cast<uint8_t>(last_consec_rx_frag & 0xFF),
-            static_cast<uint8_t>((fragment->total_frag & 0xFF00) >> 8), static_cast<uint8_t>(fragment->total_frag & 0xFF),
-            static_cast<uint8_t>((fragment->seq_num & 0xFF00) >> 8), static_cast<uint8_t>(fragment->seq_num & 0xFF)},
-            .sender_id = fragment->sender_id,
-        };
-        if (xSemaphoreTake(send_ack_queue_mutex[channel], pdMS_TO_TICKS(SEND_ACK_MUTEX_WAIT)) != pdTRUE){
-            return ESP_FAIL;
-        }
-
-        send_ack_queue[channel].push(data);
-        xSemaphoreGive(send_ack_queue_mutex[channel]);
-    }
-
-    if (metadata.num_fragments_rx == metadata_fragment_size){
-        //all fragments received
-        return complete_fragment(fragment->receiver_id, fragment->seq_num, channel);
-    }
+    uint16_t crc_16 = crc16_update(CRC16_INIT, buf, offset);
+    buf[offset++] = crc_16 & 0xFF;
+    buf[offset++] = (crc_16 >> 8) & 0xFF;
 
+    *frame_size = offset;
     return ESP_OK;
 }
 
 /**
- * @brief Removes the corresponding entry from `fragment_map` and pushes the data onto `async_receive_queue`
+ * @brief Validates the header and CRC of the frame at the start of `buf` without copying it. The payload of `view`
+ * points into `buf`
  *
- * @param board_id
- * @param sequence_num
- * @return esp_err_t
+ * @param buf Frame bytes (starting at the start of frame byte)
+ * @param buf_len
+ * @param view Parsed frame (will be written)
+ * @return esp_err_t `ESP_ERR_INVALID_SIZE` if the lengths are inconsistent, `ESP_ERR_INVALID_CRC` on a CRC mismatch
  */
-esp_err_t DataLinkManager::complete_fragment(uint16_t board_id, uint16_t sequence_num, uint8_t channel){
-    Rx_Metadata rx;
-
-    if (xSemaphoreTake(rx_fragment_mutex[channel], pdMS_TO_TICKS(ASYNC_QUEUE_WAIT_TICKS)) != pdTRUE){
-        return ESP_ERR_TIMEOUT;
+esp_err_t parse_frame(const uint8_t* buf, size_t buf_len, FrameView* view){
+    if (buf == nullptr || view == nullptr){
+        return ESP_ERR_INVALID_ARG;
     }
 
-    if (fragment_map[channel][board_id].find(sequence_num) == fragment_map[channel][board_id].end()){
-        return ESP_ERR_NOT_FOUND;
+    if (buf_len < CONTROL_FRAME_OVERHEAD){
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    FragmentMetadata& metadata = fragment_map[channel][board_id][sequence_num];
-    if (metadata.num_fragments_rx != metadata.fragments.size()){
-        return ESP_ERR_INVALID_STATE;
-    }
-    uint16_t total_data_len = metadata.num_fragments_rx*MAX_FRAME_SIZE; //max data size with n fragments
-    xSemaphoreGive(rx_fragment_mutex[channel]);
+    FrameHeader& header = view->header;
+    header.preamble = buf[0];
+    header.sender_id = buf[1];
+    header.receiver_id = buf[2];
+    header.seq_num = (uint16_t)buf[3] | ((uint16_t)buf[4] << 8);
+    header.type_flag = buf[5];
 
-    auto combined_data = std::make_unique<std::vector<uint8_t>>();
-    combined_data->resize(total_data_len);
-    rx.data_len = total_data_len;
-    if (combined_data == nullptr){
-        return ESP_ERR_NO_MEM;
-    }
+    size_t header_size = CONTROL_FRAME_HEADER_SIZE;
+    if (IS_CONTROL_FRAME(header.type_flag)){
+        header.frag_info = 0;
+        header.data_len = (uint16_t)buf[6] | ((uint16_t)buf[7] << 8);
 
-    if (rx_fragment_mutex[channel] == NULL){
-        return ESP_FAIL;
-    }
-
-    // ESP_LOGI(DEBUG_LINK_TAG, "completing %d fragments for frame %d", metadata.num_fragments_rx, sequence_num);
+        if (header.data_len == 0 || header.data_len > MAX_CONTROL_DATA_LEN){
+            return ESP_ERR_INVALID_SIZE;
+        }
+    } else {
+        if (buf_len < GENERIC_FRAME_OVERHEAD){
+            return ESP_ERR_INVALID_SIZE;
+        }
 
-    if (xSemaphoreTake(rx_fragment_mutex[channel], pdMS_TO_TICKS(ASYNC_QUEUE_WAIT_TICKS)) != pdTRUE){
-        return ESP_ERR_TIMEOUT;
-    }
+        header_size = GENERIC_FRAME_HEADER_SIZE;
+        uint16_t total_frag = (uint16_t)buf[6] | ((uint16_t)buf[7] << 8);
+        uint16_t frag_num = (uint16_t)buf[8] | ((uint16_t)buf[9] << 8);
+        header.frag_info = ((uint32_t)total_frag << 16) | frag_num;
+        header.data_len = (uint16_t)buf[10] | ((uint16_t)buf[11] << 8);
 
-    if (fragment_map[channel][board_id].find(sequence_num) == fragment_map[channel][board_id].end()){
-        xSemaphoreGive(rx_fragment_mutex[channel]);
-        return ESP_ERR_NOT_FOUND;
+        if (header.data_len > MAX_GENERIC_DATA_LEN){
+            return ESP_ERR_INVALID_SIZE;
+        }
     }
 
-    uint16_t prev_index = 0;
-    for (size_t i = 0; i < metadata.num_fragments_rx; i++){
-        memcpy(&combined_data->data()[prev_index], metadata.fragments[i].data, metadata.fragments[i].data_len);
-        prev_index += metadata.fragments[i].data_len;
+    if (header_size + header.data_len + FRAME_CRC_SIZE > buf_len){
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    xSemaphoreGive(rx_fragment_mutex[channel]);
-
-    rx.data = std::move(combined_data);
-    rx.data_len = prev_index;
+    size_t crc_offset = header_size + header.data_len;
+    uint16_t crc_rx = (uint16_t)buf[crc_offset] | ((uint16_t)buf[crc_offset + 1] << 8);
+    header.crc_16 = crc16_update(CRC16_INIT, buf, crc_offset); //every frame, `write_frame` always appends the CRC
 
-    if (async_rx_queue_mutex[channel] == nullptr){
-        return ESP_FAIL;
+    if (crc_rx != header.crc_16){
+        ESP_LOGE(DEBUG_LINK_TAG, "CRC Mismatch - got 0x%04X but calculated 0x%04X", crc_rx, header.crc_16);
+        return ESP_ERR_INVALID_CRC;
     }
 
-    GenericFrame frame = metadata.fragments[0];
-
-    rx.header = {
-        .preamble = START_OF_FRAME,
-        .sender_id = frame.sender_id,
-        .receiver_id = frame.receiver_id,
-        .seq_num = frame.seq_num,
-        .type_flag = frame.type_flag,
-        .frag_info = (uint32_t)((frame.total_frag << 16) | frame.frag_num),
-        .data_len = prev_index,
-        .crc_16 = 0
-    };
-
-    // ESP_LOGI(DEBUG_LINK_TAG, "pushing frame %d onto async rx queue", sequence_num);
+    view->data = &buf[header_size];
+    return ESP_OK;
+}
 
-    if (!async_receive_queue->enqueue(std::move(rx), std::chrono::milliseconds(ASYNC_QUEUE_WAIT_TICKS))) {
-        return ESP_ERR_TIMEOUT;
+/**
+ * @brief Derives the frame sizes from the MTU of the physical layer
+ *
+ * @param phy_mtu Max number of bytes in a single transmission of the physical layer
+ * @return FrameSizing All zeros if `phy_mtu` cannot fit the smallest generic frame
+ */
+FrameSizing make_frame_sizing(size_t phy_mtu) {
+    FrameSizing sizing{};
+    if (phy_mtu <= GENERIC_FRAME_OVERHEAD){
+        return sizing;
     }
 
-    fragment_map[channel][board_id].erase(sequence_num);
+    sizing.max_frame_size = phy_mtu < MAX_FRAME_SIZE ? phy_mtu : MAX_FRAME_SIZE;
+    sizing.max_burst_size = phy_mtu < MAX_BURST_SIZE ? phy_mtu : MAX_BURST_SIZE;
+    sizing.max_control_data_len = sizing.max_frame_size - CONTROL_FRAME_OVERHEAD;
+    sizing.max_generic_data_len = sizing.max_frame_size - GENERIC_FRAME_OVERHEAD;
+    return sizing;
+}
 
-    if (fragment_map[channel][board_id].empty()) {
-        fragment_map[channel].erase(board_id);
+/**
+ * @brief Number of generic frame fragments needed to send `data_len` bytes
+ *
+ * @param sizing
+ * @param data_len
+ * @return uint32_t
+ */
+uint32_t get_num_fragments(const FrameSizing& sizing, size_t data_len) {
+    if (sizing.max_generic_data_len == 0){
+        return 0;
     }
-
-    // ESP_LOGI(DEBUG_LINK_TAG, "frame %d pushed success", sequence_num);
-
-    return ESP_OK;
+    if (data_len <= sizing.max_generic_data_len){
+        return 1;
+    }
+    return (data_len + sizing.max_generic_data_len - 1) / sizing.max_generic_data_len;
 }
 
 /**
@@ -258,19 +216,93 @@ std::optional<std::unique_ptr<std::vector<uint8_t>>> DataLinkManager::async_rece
     // ESP_LOGI(DEBUG_LINK_TAG, "pushed frame %d onto async queue", header->seq_num);
 }
 
+/**
+ * @brief Returns the number of bytes of the frame starting at `data`, or 0 if `data` does not start with a complete frame
+ *
+ * @param data
+ * @param data_len
+ * @return size_t
+ */
+static size_t get_frame_length(const uint8_t* data, size_t data_len){
+    if (data_len < CONTROL_FRAME_HEADER_SIZE || data[0] != START_OF_FRAME){
+        return 0;
+    }
+
+    size_t header_size = CONTROL_FRAME_HEADER_SIZE;
+    uint16_t payload_len = (uint16_t)data[6] | ((uint16_t)data[7] << 8);
+
+    if (!IS_CONTROL_FRAME(data[5])){
+        if (data_len < GENERIC_FRAME_HEADER_SIZE){
+            return 0;
+        }
+        header_size = GENERIC_FRAME_HEADER_SIZE;
+        payload_len = (uint16_t)data[10] | ((uint16_t)data[11] << 8);
+    }
+
+    if (payload_len > (header_size == CONTROL_FRAME_HEADER_SIZE ? MAX_CONTROL_DATA_LEN : MAX_GENERIC_DATA_LEN)){
+        return 0; //corrupted length - not trusted to find the next frame
+    }
+
+    size_t frame_len = header_size + payload_len + FRAME_CRC_SIZE;
+    return frame_len <= data_len ? frame_len : 0;
+}
+
 esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
-    uint16_t data_len = MAX_FRAME_SIZE; //max possible data len
-    uint8_t data[data_len];
+    uint8_t* data = rx_buffers[channel].get();
+    if (data == nullptr){
+        return ESP_ERR_INVALID_STATE;
+    }
 
     size_t recv_len = 0;
 
-    esp_err_t res = phys_comms->receive(data, data_len, &recv_len, channel);
+    esp_err_t res = phys_comms->receive(data, frame_sizing.max_burst_size, &recv_len, channel);
 
     if (res != ESP_OK){
         // ESP_LOGE(DEBUG_LINK_TAG, "RMT Failed to receive - recieve_rmt");
         return ESP_ERR_TIMEOUT;
     }
 
+    //a transmission can hold several frames back to back (see `scheduler_send`)
+    size_t offset = 0;
+    while (offset < recv_len){
+        size_t frame_len = get_frame_length(&data[offset], recv_len - offset);
+        if (frame_len == 0){
+            //not the start of a (complete) frame - resync on the next start of frame byte
+            offset++;
+            while (offset < recv_len && data[offset] != START_OF_FRAME){
+                offset++;
+            }
+            res = ESP_ERR_INVALID_RESPONSE;
+            continue;
+        }
+
+        esp_err_t frame_res = process_frame(&data[offset], frame_len, channel);
+        if (frame_res != ESP_OK){
+            res = frame_res;
+        }
+        if (frame_res == ESP_ERR_INVALID_CRC){
+            //the length the frame was split with may be the corrupted part - resync on the next start of frame byte
+            offset++;
+            while (offset < recv_len && data[offset] != START_OF_FRAME){
+                offset++;
+            }
+            continue;
+        }
+        offset += frame_len;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Handles a single frame received on `channel`
+ *
+ * @param data Frame bytes (starting at the start of frame byte)
+ * @param recv_len Length of the frame
+ * @param channel
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::process_frame(uint8_t* data, size_t recv_len, uint8_t channel){
     if (recv_len > MAX_FRAME_SIZE){
         ESP_LOGE(DEBUG_LINK_TAG, "Received frame is too large to be control or generic");
         return ESP_ERR_INVALID_RESPONSE;
@@ -281,18 +313,26 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
         return ESP_ERR_INVALID_RESPONSE;
     }
 
-    auto message = std::make_unique<std::vector<uint8_t>>();
-    message->resize(MAX_FRAME_SIZE);
-
-    size_t message_size = 0;
-    FrameHeader header;
+    esp_err_t res;
 
-    res = get_data_from_frame(data, recv_len, message->data(), &message_size, &header);
+    //parsed in place - the payload stays in the RX buffer until the frame is handed to `async_receive_queue`
+    FrameView frame;
+    res = parse_frame(data, recv_len, &frame);
     if (res != ESP_OK){
-        // print_buffer_binary(message, message_size);
         return res;
     }
-    message->resize(message_size);
+    const FrameHeader& header = frame.header;
+    const uint8_t* message = frame.data;
+    size_t message_size = header.data_len;
+    link_training[channel].last_rx_us = esp_timer_get_time();
+
+    if (header.receiver_id != this_board_id && header.receiver_id != BROADCAST_ADDR){
+        //not for this board - control frames that already went through (eg. looped back) are not sent again
+        if (IS_CONTROL_FRAME(header.type_flag) && is_duplicate_frame(header)){
+            return ESP_OK;
+        }
+        return forward_frame(frame);
+    }
 
     // print_buffer_binary(message, message_size);
 
@@ -302,14 +342,15 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
             return ESP_OK;
         }
 
-        if (message->data()[0] != GENERIC_FRAG_ACK_PREAMBLE){
+        if (message[0] != GENERIC_FRAG_ACK_PREAMBLE){
             return ESP_OK;
         }
 
         FrameAckRecord record = {
-            .last_ack = static_cast<uint16_t>((message->data()[1] << 8) | (message->data()[2])),
-            .total_frags = static_cast<uint16_t>((message->data()[3] << 8) | (message->data()[4])),
-            .seq_num = static_cast<uint16_t>((message->data()[5] << 8) | (message->data()[6]))
+            .last_ack = static_cast<uint16_t>((message[1] << 8) | (message[2])),
+            .total_frags = static_cast<uint16_t>((message[3] << 8) | (message[4])),
+            .seq_num = static_cast<uint16_t>((message[5] << 8) | (message[6])),
+            .sack = (static_cast<uint32_t>(message[7]) << 24) | (static_cast<uint32_t>(message[8]) << 16) | (static_cast<uint32_t>(message[9]) << 8) | message[10],
         };
 
         res = inc_head_sliding_window(channel, header.sender_id, record.seq_num, &record);
@@ -325,60 +366,55 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
 
     if (!IS_CONTROL_FRAME(header.type_flag)){
         //Handle generic frame fragment
-        GenericFrame frame = make_generic_frame_from_header(header);
-        if (message_size > MAX_FRAME_SIZE){
-            return ESP_FAIL;
-        }
-
-        memcpy(frame.data, message->data(), message_size);
-        esp_err_t res = store_fragment(&frame, channel);
-        return res;
+        return store_fragment(frame, channel);
     }
 
     //control frame handling: - TODO: clean up :)
     // ESP_LOGI(DEBUG_LINK_TAG, "Received frame of type 0x%X destined for board %d", GET_TYPE(header.type_flag), header.receiver_id);
 
+    if (static_cast<FrameType>(GET_TYPE(header.type_flag)) == FrameType::LINK_TRAINING_CONTROL){
+        return handle_link_training_frame(channel, message, message_size);
+    }
+
     //check for a rip frame
     if (static_cast<FrameType>(GET_TYPE(header.type_flag)) == FrameType::RIP_TABLE_CONTROL){
         ESP_LOGI(DEBUG_LINK_TAG, "Got a RIP frame");
 
-        for (size_t i = 0; i < message_size-1; i+=2){
-            uint8_t board_id = message->data()[i];
-            uint8_t hops = message->data()[i+1];
-            // ESP_LOGI(DEBUG_LINK_TAG, "Received: board_id %d and number of hops %d on channel %d", board_id, hops, channel);
-
-            RIPRow* entry = nullptr;
-
-            res = rip_find_entry(board_id, &entry, true);
-            if (res != ESP_OK){
-                return ESP_FAIL;
-            }
+        //the same board can be advertised on several channels at once, and the RIP tasks update the table too
+        if (xSemaphoreTake(rip_write_mutex, pdMS_TO_TICKS(RIP_MAX_SEM_WAIT_MS)) != pdTRUE){
+            return ESP_ERR_TIMEOUT;
+        }
 
-            if (entry == nullptr){
-                printf("rip pointer\n");
-                return ESP_FAIL; //no room for more entries in the table
-            }
+        for (size_t i = 0; i + 1 < message_size; i+=2){
+            uint8_t board_id = message[i];
+            uint8_t hops = message[i+1];
+            // ESP_LOGI(DEBUG_LINK_TAG, "Received: board_id %d and number of hops %d on channel %d", board_id, hops, channel);
 
-            if (entry->valid == RIP_NEW_ROW){
-                //adding a new entry
-                rip_add_entry(board_id, hops + 1, channel, &entry);
-            } else {
-                //updating an entry
-                rip_update_entry(hops + 1, channel, &entry);
+            RIPRow entry;
+            uint8_t new_hop = hops >= RIP_MAX_HOPS ? RIP_MAX_HOPS + 1 : hops + 1;
+            if (rip_update_entry(board_id, new_hop, channel, &entry) != ESP_OK){
+                continue; //not a board id
             }
 
             if (GET_FLAG(header.type_flag) == FLAG_DISCOVERY){
                 //discovery -> send routing table
                 // ESP_LOGI(DEBUG_LINK_TAG, "got discovery reply");
                 RIPRow_public row_queue = {
-                    .info = entry->info,
-                    .channel = entry->channel
+                    .info = entry.info,
+                    .channel = entry.channel
                 };
 
                 xQueueSendToBack(discovery_tables, &row_queue, (TickType_t)10);
             }
 
         }
+        xSemaphoreGive(rip_write_mutex);
+
+        if (header.sender_id != this_board_id && header.sender_id != BROADCAST_ADDR && header.sender_id != PC_ADDR){
+            //the sender of a RIP frame is always one hop away on this channel
+            request_link_training(channel, header.sender_id);
+        }
+
         if (message_size == RIP_DISCOVERY_MESSAGE_SIZE){
             res = send_rip_frame(false, header.sender_id);
             if (res != ESP_OK){
@@ -390,23 +426,16 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
         return res;
     }
 
-    uint16_t seq_num = 0;
-
-    res = get_sequence_num(header.receiver_id, &seq_num);
-
-    if (res != ESP_OK){
-        return res;
+    if (is_duplicate_frame(header)){
+        //eg. the same frame came in on two channels, or was sent again - dropped before copying the payload
+        return ESP_OK;
     }
 
-    //got frame but not destined for this board
-    if (header.receiver_id != this_board_id && header.receiver_id != BROADCAST_ADDR && header.seq_num > seq_num){
-        // ESP_LOGI(DEBUG_LINK_TAG, "Sending message to board %d with message %s", header.receiver_id, message);
-        res = send(header.receiver_id, std::move(message), FrameType::MISC_CONTROL_TYPE, 0);
-        return res;
-    }
+    //the payload leaves the RX buffer here
+    auto buffer = std::make_unique<std::vector<uint8_t>>(message, message + message_size);
 
     Rx_Metadata metadata = {
-        .data = std::move(message),
+        .data = std::move(buffer),
         .data_len = (uint16_t)message_size,
         .header = header
     };
@@ -417,29 +446,84 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
     return ESP_OK;
 }
 
+/**
+ * @brief Cut-through forwarding of a frame addressed to another board. The frame is queued on the channel of its
+ * route as soon as it arrives, with its header untouched (sender, sequence number and fragment info), so fragments of
+ * generic frames are not reassembled on the way and the ACKs of the destination go back to the original sender
+ *
+ * @param frame Frame parsed in place (see `parse_frame`), its payload is copied out of the RX buffer
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::forward_frame(const FrameView& frame){
+    uint8_t channel = 0;
+    esp_err_t res = route_frame(frame.header.receiver_id, &channel);
+    if (res != ESP_OK){
+        // ESP_LOGE(DEBUG_LINK_TAG, "No route to forward frame to board %d", frame.header.receiver_id);
+        return res;
+    }
+
+    SchedulerMetadata metadata = {
+        .header = frame.header,
+        .generic_frame_data_offset = 0,
+        .enqueue_time_ns = 0,
+        .data = std::make_shared<std::vector<uint8_t>>(frame.data, frame.data + frame.header.data_len),
+        .last_ack = 0,
+        .curr_fragment = 0,
+        .next_tx_us = 0,
+        .deadline_us = 0,
+        .coalesce_key = 0,
+    };
+
+    //a fragment fits in a single frame, so it goes through the class queues like any other frame (not the transmit
+    //state table) and is sent as is
+    return push_frame_to_scheduler(metadata, channel);
+}
+
+/**
+ * @brief Whether the control frame `header` was already received (see `replay_windows`). Records it otherwise
+ *
+ * @param header
+ * @return true
+ * @return false
+ */
+bool DataLinkManager::is_duplicate_frame(const FrameHeader& header){
+    if (xSemaphoreTake(replay_windows_mutex, pdMS_TO_TICKS(SEQUENCE_NUM_MAP_MUTEX_MAX_WAIT_MS)) != pdTRUE){
+        return false; //better a duplicate than a lost frame
+    }
+
+    uint16_t key = (static_cast<uint16_t>(header.sender_id) << 8) | header.receiver_id;
+    bool duplicate = !replay_window_update(&replay_windows[key], header.seq_num);
+    xSemaphoreGive(replay_windows_mutex);
+
+    return duplicate;
+}
+
 [[noreturn]] void DataLinkManager::receive_thread_main(void* args){
-    DataLinkManager* link_layer_obj = static_cast<DataLinkManager*>(args);
+    const auto parsed_args = static_cast<frame_scheduler_args*>(args);
+    uint8_t channel = parsed_args->channel_id;
+    DataLinkManager* link_layer_obj = parsed_args->that;
     if (link_layer_obj == nullptr || link_layer_obj->manual_broadcasts == nullptr){
         ESP_LOGE(DEBUG_LINK_TAG, "Receive thread failed to start due to invalid pointer");
+        if (link_layer_obj != nullptr){
+            link_layer_obj->receive_tasks[channel] = NULL; //not deleted again by the destructor
+        }
+        free(args);
         vTaskDelete(nullptr);
     }
 
-    ESP_LOGI(DEBUG_LINK_TAG, "Starting Receive thread task");
+    ESP_LOGI(DEBUG_LINK_TAG, "Starting Receive thread task on channel %d", channel);
 
-    esp_err_t res;
-
-    for (uint8_t i = 0; i < link_layer_obj->num_channels; i++){
-        res = link_layer_obj->start_receive_frames_rmt(i);
-    }
+    link_layer_obj->start_receive_frames_rmt(channel);
     while(!link_layer_obj->stop_tasks){
-        for (uint8_t i = 0; i < link_layer_obj->num_channels; i++){
-            res = link_layer_obj->receive_rmt(i);
-            res = link_layer_obj->start_receive_frames_rmt(i);
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(RECEIVE_TASK_PERIOD_MS));
+        //blocks on this channel only - the physical layer restarts the RX job as soon as a frame arrives
+        link_layer_obj->receive_rmt(channel);
+        link_layer_obj->start_receive_frames_rmt(channel); //only needed if restarting the RX job failed (no-op otherwise)
+        link_layer_obj->link_training_check(channel);
     }
 
+    free(args);
+    //deleted by the destructor once suspended (see `stop_task`), so it is never deleted twice
+    vTaskSuspend(nullptr);
     vTaskDelete(nullptr);
 }
 
@@ -447,39 +531,59 @@ esp_err_t DataLinkManager::receive_rmt(uint8_t channel){
     DataLinkManager* link_layer_obj = static_cast<DataLinkManager*>(args);
     if (link_layer_obj == nullptr || link_layer_obj->manual_broadcasts == nullptr){
         ESP_LOGE(DEBUG_LINK_TAG, "Send Ack thread failed to start due to invalid pointer");
+        if (link_layer_obj != nullptr){
+            link_layer_obj->send_ack_task = NULL; //not deleted again by the destructor
+        }
         vTaskDelete(nullptr);
     }
 
     for (uint8_t i = 0; i < link_layer_obj->num_channels; i++){
-        if (link_layer_obj->send_ack_queue_mutex[i] == NULL){
+        if (link_layer_obj->pending_acks_mutex[i] == NULL){
             ESP_LOGE(DEBUG_LINK_TAG, "%d send ack queue mutex is null!", i);
+            link_layer_obj->send_ack_task = NULL;
             vTaskDelete(nullptr);
         }
     }
 
     ESP_LOGI(DEBUG_LINK_TAG, "Starting Send ACK task");
 
-    esp_err_t res;
+    std::vector<SendAckMetaData> acks;
+    bool retry = false;
 
     while(!link_layer_obj->stop_tasks){
-        for (uint8_t channel = 0; channel < link_layer_obj->num_channels; channel++){
-            vTaskDelay(pdMS_TO_TICKS(SEND_ACK_PERIOD_MS));
+        link_layer_obj->reassembly_sweep();
+
+        if (!retry && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SEND_ACK_IDLE_POLL_MS)) == 0){
+            continue;
+        }
+        retry = false;
+
+        //gives the next fragments of the frame time to arrive (their ACK replaces this one) and the scheduler a chance
+        //to piggyback the ACK on a burst to the same neighbour (see `scheduler_piggyback_acks`)
+        TickType_t delay_ticks = pdMS_TO_TICKS(SEND_ACK_DELAY_MS);
+        vTaskDelay(delay_ticks > 0 ? delay_ticks : 1);
 
-            if (xSemaphoreTake(link_layer_obj->send_ack_queue_mutex[channel], pdMS_TO_TICKS(SEND_ACK_MUTEX_WAIT)) != pdTRUE){
+        for (uint8_t channel = 0; channel < link_layer_obj->num_channels; channel++){
+            if (xSemaphoreTake(link_layer_obj->pending_acks_mutex[channel], pdMS_TO_TICKS(SEND_ACK_MUTEX_WAIT)) != pdTRUE){
+                retry = true;
                 continue;
             }
 
-            if (link_layer_obj->send_ack_queue[channel].empty()){
-                xSemaphoreGive(link_layer_obj->send_ack_queue_mutex[channel]);
-                continue;
+            for (auto& [key, data] : link_layer_obj->pending_acks[channel]){
+                acks.push_back(data);
             }
+            link_layer_obj->pending_acks[channel].clear();
+            xSemaphoreGive(link_layer_obj->pending_acks_mutex[channel]);
 
-            SendAckMetaData data = link_layer_obj->send_ack_queue[channel].front();
-            link_layer_obj->send_ack_queue[channel].pop();
-            link_layer_obj->send_ack(data.sender_id, data.data, GENERIC_FRAG_ACK_DATA_SIZE);
-            xSemaphoreGive(link_layer_obj->send_ack_queue_mutex[channel]);
+            //sent without the mutex held, so the receive thread is not held up while the ACKs are scheduled
+            for (SendAckMetaData& data : acks){
+                link_layer_obj->send_ack(data.sender_id, data.data, GENERIC_FRAG_ACK_DATA_SIZE);
+            }
+            acks.clear();
         }
     }
 
+    //deleted by the destructor once suspended (see `stop_task`)
+    vTaskSuspend(nullptr);
     vTaskDelete(nullptr);
 }
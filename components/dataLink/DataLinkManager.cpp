@@ -1,26 +1,63 @@
 #include "DataLinkManager.h"
 #include "BlockingQueue.h"
 #include "Frames.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "VirtualWireManager.h"
+#else
 #include "RMTManager.h"
+#endif
 #include "esp_log.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
 #include <memory>
 
-#define SCHEDULE_QUEUE_SIZE 25
 
 /**
- * @brief Constructs a new Data Link Manager object
+ * @brief Creates the physical layer used when none is given to the constructor
+ *
+ * @note There is no RMT peripheral on the `linux` target, so the board is attached to its own (unplugged) virtual wire
+ *
+ * @param num_channels
+ * @return std::unique_ptr<IPhysicalLayer>
+ */
+static std::unique_ptr<IPhysicalLayer> make_default_phys_layer(uint8_t num_channels){
+#if CONFIG_IDF_TARGET_LINUX
+    return std::make_unique<VirtualWireManager>(std::make_shared<VirtualWire>(1), 0, num_channels);
+#else
+    return std::make_unique<RMTManager>(num_channels);
+#endif
+}
+
+/**
+ * @brief Constructs a new Data Link Manager object using the RMT physical layer
+ *
+ * @param board_id Board ID of the current board. Will be written to the NVM under key "board" if not already written.
+ */
+DataLinkManager::DataLinkManager(uint8_t board_id, uint8_t num_channels = MAX_CHANNELS)
+    : DataLinkManager(board_id, num_channels, make_default_phys_layer(num_channels)){
+}
+
+/**
+ * @brief Constructs a new Data Link Manager object on top of a given physical layer
  *
  * @param board_id Board ID of the current board. Will be written to the NVM under key "board" if not already written.
+ * @param num_channels Number of channels used by `phys_layer`
+ * @param phys_layer Physical layer to send/receive the frames with (eg. `RMTManager` or `VirtualWireManager`)
  */
-DataLinkManager::DataLinkManager(uint8_t board_id, uint8_t num_channels = MAX_CHANNELS){
+DataLinkManager::DataLinkManager(uint8_t board_id, uint8_t num_channels, std::unique_ptr<IPhysicalLayer>&& phys_layer, bool train_on_discovery){
     //init table for this board and set up link layer priority queue
-    phys_comms = std::make_unique<RMTManager>(num_channels);
+    phys_comms = std::move(phys_layer);
     if (phys_comms == nullptr){
         ESP_LOGE(DEBUG_LINK_TAG, "RMT object was not created. Link layer communications will not function.");
         return;
     }
 
+    frame_sizing = make_frame_sizing(phys_comms->get_mtu());
+    if (frame_sizing.max_frame_size == 0){
+        ESP_LOGE(DEBUG_LINK_TAG, "MTU of the physical layer (%d B) is too small to fit a frame", phys_comms->get_mtu());
+    }
+
     uint8_t existing_board_id = 0;
     get_board_id(existing_board_id);
 
@@ -30,15 +67,21 @@ DataLinkManager::DataLinkManager(uint8_t board_id, uint8_t num_channels = MAX_CH
     }
 
     this->num_channels = num_channels;
+    this->train_on_discovery = train_on_discovery;
 
     sequence_num_map_mutex = xSemaphoreCreateMutex();
+    rip_write_mutex = xSemaphoreCreateMutex();
+    reassembly_mutex = xSemaphoreCreateMutex();
+    replay_windows_mutex = xSemaphoreCreateMutex();
 
     for (int i = 0; i < MAX_CHANNELS; i++) {
-        frame_queue[i] = std::make_unique<BlockingPriorityQueue<SchedulerMetadata, std::vector<SchedulerMetadata>, FrameCompare>>(SCHEDULE_QUEUE_SIZE);
+        tx_ring[i] = std::make_unique<SchedulerTxRing>();
+        frame_queue[i] = std::make_unique<SchedulerQueue>(scheduler_queue_config);
     }
 
     async_receive_queue = std::make_unique<BlockingQueue<Rx_Metadata>>(MAX_RX_QUEUE_SIZE);
 
+    init_link_training();
     init_scheduler();
     init_rip();
 }
@@ -49,40 +92,39 @@ DataLinkManager::DataLinkManager(uint8_t board_id, uint8_t num_channels = MAX_CH
  * @return esp_err_t
  */
 esp_err_t DataLinkManager::ready(){
-    return (phys_comms == nullptr || rip_broadcast_task == NULL || rip_ttl_task == NULL || scheduler_task == NULL || receive_task == NULL) ? ESP_FAIL : ESP_OK;
-}
-
-/**
- * @brief Atomic function to get and post increment sequence number map
- *
- * @param board_id
- * @param seq_num
- * @return esp_err_t
- */
-esp_err_t DataLinkManager::get_inc_sequence_num(uint8_t board_id, uint16_t* seq_num){
-    if (seq_num == NULL){
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (xSemaphoreTake(sequence_num_map_mutex, pdMS_TO_TICKS(SEQUENCE_NUM_MAP_MUTEX_MAX_WAIT_MS)) != pdTRUE){
+    if (phys_comms == nullptr || rip_broadcast_task == NULL || rip_ttl_task == NULL){
         return ESP_FAIL;
     }
 
-    *seq_num = sequence_num_map[board_id]++;
-
-    xSemaphoreGive(sequence_num_map_mutex);
+    for (uint8_t i = 0; i < num_channels; i++){
+        if (scheduler_tasks[i] == NULL || receive_tasks[i] == NULL){
+            return ESP_FAIL;
+        }
+    }
 
     return ESP_OK;
 }
 
 /**
- * @brief Atomic function to get sequence number map
+ * @brief Returns the frame sizes used to send over the physical layer
+ *
+ * @return FrameSizing
+ */
+FrameSizing DataLinkManager::get_frame_sizing() const{
+    return frame_sizing;
+}
+
+/**
+ * @brief Atomic function to get and post increment sequence number map
+ *
+ * @note The counter of each destination starts at a random value: a board that rebooted does not reuse the sequence
+ * numbers it sent just before, which the receivers would still drop as duplicates (see `replay_window_update`)
  *
  * @param board_id
  * @param seq_num
  * @return esp_err_t
  */
-esp_err_t DataLinkManager::get_sequence_num(uint8_t board_id, uint16_t* seq_num){
+esp_err_t DataLinkManager::get_inc_sequence_num(uint8_t board_id, uint16_t* seq_num){
     if (seq_num == NULL){
         return ESP_ERR_INVALID_ARG;
     }
@@ -91,41 +133,76 @@ esp_err_t DataLinkManager::get_sequence_num(uint8_t board_id, uint16_t* seq_num)
         return ESP_FAIL;
     }
 
-    *seq_num = sequence_num_map[board_id];
+    auto [entry, inserted] = sequence_num_map.try_emplace(board_id);
+    if (inserted){
+        entry->second = static_cast<uint16_t>(esp_random());
+    }
+    *seq_num = entry->second++;
 
     xSemaphoreGive(sequence_num_map_mutex);
 
     return ESP_OK;
 }
 
+/**
+ * @brief Stops every task of the link layer before the object goes away
+ *
+ * @note Link training is stopped first (it waits on replies from the receive tasks). Then producers are stopped
+ * before the tasks they notify: the receive tasks (notify the send ACK task), the RIP tasks, the send ACK task, then
+ * the schedulers (notified by all of them)
+ */
 DataLinkManager::~DataLinkManager(){
     stop_tasks = true;
 
-    bool dummy = true;
-    xQueueSend(manual_broadcasts, &dummy, 0);
-
-    vTaskDelay(pdMS_TO_TICKS(100)); //delay to allow tasks to be killed
+    if (manual_broadcasts != NULL){
+        bool dummy = true;
+        xQueueSend(manual_broadcasts, &dummy, 0); //wakes the RIP broadcast task
+    }
 
-    if (rip_broadcast_task == NULL){
-        vTaskDelete(rip_broadcast_task);
-        rip_broadcast_task = NULL;
+    //waits on replies from the receive tasks, and finishes its current trial first
+    stop_task(&link_training_task, LINK_TRAINING_STOP_WAIT_MS);
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++){
+        stop_task(&receive_tasks[i]);
+    }
+    stop_task(&rip_broadcast_task);
+    stop_task(&rip_ttl_task);
+    stop_task(&send_ack_task);
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++){
+        stop_task(&scheduler_tasks[i]);
     }
-    if (rip_ttl_task == NULL){
-        vTaskDelete(rip_ttl_task);
-        rip_ttl_task = NULL;
+
+    //nothing waits on a frame gap anymore
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++){
+        if (frame_gap_timers[i] != nullptr){
+            esp_timer_stop(frame_gap_timers[i]);
+            esp_timer_delete(frame_gap_timers[i]);
+            frame_gap_timers[i] = nullptr;
+        }
     }
-    if (scheduler_task == NULL){
-        vTaskDelete(scheduler_task);
-        scheduler_task = NULL;
+}
+
+/**
+ * @brief Wakes `task` until it suspends itself (every task does once `stop_tasks` is set), then deletes it. A task
+ * is never deleted while it runs, so it cannot be stopped in the middle of using the object
+ *
+ * @param task Set to NULL once deleted (nothing to do if already NULL)
+ * @param wait_ms How long to wait for the task to suspend itself
+ */
+void DataLinkManager::stop_task(TaskHandle_t* task, uint32_t wait_ms){
+    if (*task == NULL){
+        return;
     }
-    if (receive_task == NULL){
-        vTaskDelete(receive_task);
-        receive_task = NULL;
+
+    for (uint32_t waited_ms = 0; eTaskGetState(*task) != eSuspended && waited_ms < wait_ms; waited_ms += TASK_STOP_POLL_MS){
+        xTaskNotifyGive(*task); //tasks sleeping on their notification (scheduler, RIP TTL, send ACK) check `stop_tasks` right away
+        vTaskDelay(pdMS_TO_TICKS(TASK_STOP_POLL_MS));
     }
-    if (send_ack_task == NULL){
-        vTaskDelete(send_ack_task);
-        send_ack_task = NULL;
+
+    if (eTaskGetState(*task) != eSuspended){
+        ESP_LOGE(DEBUG_LINK_TAG, "Task %s did not stop within %lu ms", pcTaskGetName(*task), (unsigned long)wait_ms);
     }
+    vTaskDelete(*task);
+    *task = NULL;
 }
 
 esp_err_t DataLinkManager::set_board_id(uint8_t board_id){
@@ -185,169 +262,6 @@ esp_err_t DataLinkManager::get_board_id(uint8_t& board_id){
     return ESP_OK;
 }
 
-/**
- * @brief Helper function to create a control frame
- *
- * @param dest_board
- * @param data
- * @param data_len
- * @param type
- * @param flag
- * @return esp_err_t
- */
-esp_err_t DataLinkManager::create_control_frame(uint8_t* data, uint16_t data_len, ControlFrame control_frame, uint8_t* send_data, size_t* send_data_len){
-    if (data == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Data array does not exist");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (this_board_id == PC_ADDR){
-        ESP_LOGE(DEBUG_LINK_TAG, "This board is not assigned a board id");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (data_len > MAX_FRAME_SIZE){
-        ESP_LOGE(DEBUG_LINK_TAG, "Data for control frame is too large. Maximum size is %d. Current data length is %d", MAX_FRAME_SIZE, data_len);
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (send_data == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Invalid pointer for send_data");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (send_data_len == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Invalid pointer for send_data_len");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (*send_data_len < sizeof(ControlFrame)){
-        ESP_LOGE(DEBUG_LINK_TAG, "Send data array is too small");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (!IS_CONTROL_FRAME(control_frame.type_flag)){
-        ESP_LOGE(DEBUG_LINK_TAG, "Must be a control frame type");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    size_t offset = 0;
-    send_data[offset++] = control_frame.preamble;
-    send_data[offset++] = control_frame.sender_id;
-    send_data[offset++] = control_frame.receiver_id;
-    send_data[offset++] = control_frame.seq_num & 0xFF;
-    send_data[offset++] = (control_frame.seq_num >> 8) & 0xFF;
-    send_data[offset++] = control_frame.type_flag;
-    send_data[offset++] = data_len;
-    send_data[offset++] = (data_len >> 8) & 0xFF;
-
-    memcpy(&send_data[offset], data, data_len);
-
-    offset += control_frame.data_len;
-
-    geneate_crc_16(send_data, offset, &control_frame.crc_16);
-
-    send_data[offset++] = control_frame.crc_16 & 0xFF;
-    send_data[offset++] = (control_frame.crc_16 >> 8) & 0xFF;
-
-    *send_data_len = offset;
-
-    // printf("Sending Frame Information:\n");
-    // printf("%-10s %-12s %-13s %-15s %-12s %-10s %-6s\n",
-    // "Preamble", "Sender ID", "Receiver ID", "Sequence Num", "Type+Flag", "Data Len", "CRC");
-
-    // printf("0x%02X       %-12d %-13d %-15d  0x%02X       %-10d   0x%04X\n",
-    // control_frame.preamble, control_frame.sender_id, control_frame.receiver_id, control_frame.seq_num, control_frame.type_flag, control_frame.data_len, control_frame.crc_16);
-
-    return ESP_OK;
-}
-
-/**
- * @brief Helper function to create a generic frame
- *
- * @param data
- * @param data_len
- * @param generic_frame
- * @param offset
- * @param send_data
- * @param send_data_len
- * @return esp_err_t
- */
-esp_err_t DataLinkManager::create_generic_frame(uint8_t* data, uint16_t data_len, GenericFrame generic_frame, uint16_t offset, uint8_t* send_data, size_t* send_data_len){
-        if (data == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Data array does not exist");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (this_board_id == PC_ADDR){
-        ESP_LOGE(DEBUG_LINK_TAG, "This board is not assigned a board id");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (data_len > MAX_FRAME_SIZE){
-        ESP_LOGE(DEBUG_LINK_TAG, "Data for generic frame is too large. Maximum size is %d. Current data length is %d", MAX_FRAME_SIZE, data_len);
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (send_data == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Invalid pointer for send_data");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (send_data_len == nullptr){
-        ESP_LOGE(DEBUG_LINK_TAG, "Invalid pointer for send_data_len");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (*send_data_len < sizeof(GenericFrame)){
-        ESP_LOGE(DEBUG_LINK_TAG, "Send data array is too small");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (IS_CONTROL_FRAME(generic_frame.type_flag)){
-        ESP_LOGE(DEBUG_LINK_TAG, "Must be a generic frame type");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    size_t send_data_offset = 0;
-    send_data[send_data_offset++] = generic_frame.preamble;
-    send_data[send_data_offset++] = generic_frame.sender_id;
-    send_data[send_data_offset++] = generic_frame.receiver_id;
-    send_data[send_data_offset++] = generic_frame.seq_num & 0xFF;
-    send_data[send_data_offset++] = (generic_frame.seq_num >> 8) & 0xFF;
-
-    send_data[send_data_offset++] = generic_frame.type_flag;
-
-    send_data[send_data_offset++] = generic_frame.total_frag & 0xFF;
-    send_data[send_data_offset++] = (generic_frame.total_frag >> 8) & 0xFF;
-
-    send_data[send_data_offset++] = generic_frame.frag_num & 0xFF;
-    send_data[send_data_offset++] = (generic_frame.frag_num >> 8) & 0xFF;
-
-    send_data[send_data_offset++] = data_len;
-    send_data[send_data_offset++] = (data_len >> 8) & 0xFF;
-
-    memcpy(&send_data[send_data_offset], &data[offset], data_len);
-
-    send_data_offset += data_len;
-
-    geneate_crc_16(send_data, send_data_offset, &generic_frame.crc_16);
-
-    send_data[send_data_offset++] = generic_frame.crc_16 & 0xFF;
-    send_data[send_data_offset++] = (generic_frame.crc_16 >> 8) & 0xFF;
-
-    *send_data_len = send_data_offset;
-
-    // printf("Sending Frame Information:\n");
-    // printf("%-10s %-12s %-13s %-15s %-12s %-10s %-6s\n",
-    // "Preamble", "Sender ID", "Receiver ID", "Sequence Num", "Type+Flag", "Data Len", "CRC");
-
-    // printf("0x%02X       %-12d %-13d %-15d  0x%02X       %-10d   0x%04X\n",
-    // generic_frame.preamble, generic_frame.sender_id, generic_frame.receiver_id, generic_frame.seq_num, generic_frame.type_flag, generic_frame.data_len, generic_frame.crc_16);
-
-    return ESP_OK;
-}
-
 /**
  * @brief Schedules a frame to be sent via RMT
  *
@@ -355,18 +269,28 @@ esp_err_t DataLinkManager::create_generic_frame(uint8_t* data, uint16_t data_len
  * @param data
  * @param data_len Length of the data in bytes
  * @param type
+ * @param deadline_us Control frames only: time (`esp_timer_get_time`) after which the frame is dropped rather than
+ * sent, 0 for none. Queued control frames are sent earliest deadline first
+ * @param coalesce_key Control frames only: replaces the queued frame with the same key (eg. destination and MPI tag)
+ * if it was not sent yet, 0 for none
  * @return esp_err_t
  */
-esp_err_t DataLinkManager::send(uint8_t dest_board, std::unique_ptr<std::vector<uint8_t>>&& buffer, FrameType type, uint8_t flag){
+esp_err_t DataLinkManager::send(uint8_t dest_board, std::unique_ptr<std::vector<uint8_t>>&& buffer, FrameType type, uint8_t flag,
+                                int64_t deadline_us, uint32_t coalesce_key){
     bool isControlFrame = IS_CONTROL_FRAME((uint8_t)type);
 
-    if (isControlFrame && buffer->size() > MAX_FRAME_SIZE){
-        //Control frames has max data size of MAX_FRAME_SIZE
+    if (!isControlFrame && (deadline_us != 0 || coalesce_key != 0)){
+        //generic frames are fragmented and ack'd, dropping or replacing them part way would stall the receiver
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (isControlFrame && buffer->size() > frame_sizing.max_control_data_len){
+        //Control frames are never fragmented, so the data must fit in a single frame
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (!isControlFrame && buffer->size() > MAX_GENERIC_NUM_FRAG * MAX_GENERIC_DATA_LEN){
-        //Generic frames has max MAX_GENERIC_NUM_FRAG fragments, each max size of MAX_GENERIC_DATA_LEN (data size)
+    if (!isControlFrame && buffer->size() > MAX_GENERIC_NUM_FRAG * frame_sizing.max_generic_data_len){
+        //Generic frames has max MAX_GENERIC_NUM_FRAG fragments, each max size of frame_sizing.max_generic_data_len (data size)
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -378,12 +302,7 @@ esp_err_t DataLinkManager::send(uint8_t dest_board, std::unique_ptr<std::vector<
     //calculate number of fragments required (for generic frames only)
     uint32_t frag_info = 0;
     if (!isControlFrame){
-        if (buffer->size() <= MAX_CONTROL_DATA_LEN){
-            frag_info = (1 << 16); //1 total fragment required
-        } else {
-            uint32_t total_frags = (buffer->size() + MAX_GENERIC_DATA_LEN - 1) / MAX_GENERIC_DATA_LEN;
-            frag_info = (total_frags) << 16;
-        }
+        frag_info = get_num_fragments(frame_sizing, buffer->size()) << 16;
     }
 
     uint16_t seq_num = 0;
@@ -410,7 +329,9 @@ esp_err_t DataLinkManager::send(uint8_t dest_board, std::unique_ptr<std::vector<
         .data = std::move(buffer),
         .last_ack = 0,
         .curr_fragment = 0,
-        .timeout = 0,
+        .next_tx_us = 0,
+        .deadline_us = deadline_us,
+        .coalesce_key = coalesce_key,
     };
 
     uint8_t channel = 0;
@@ -484,7 +405,7 @@ esp_err_t DataLinkManager::receive(uint8_t* data, size_t data_len, size_t* recv_
 }
 
 /**
- * @brief
+ * @brief Copies the data of a received frame into `message` (see `parse_frame` to read it in place)
  *
  * @param data
  * @param data_len
@@ -514,85 +435,16 @@ esp_err_t DataLinkManager::get_data_from_frame(uint8_t* data, size_t data_len, u
         return ESP_ERR_INVALID_ARG;
     }
 
-    header->preamble = data[0];
-    header->sender_id = data[1];
-    header->receiver_id = data[2];
-    header->seq_num = (uint16_t)data[3] | ((uint16_t)data[4] << 8);
-    header->type_flag = data[5];
-    if (IS_CONTROL_FRAME(data[5])){
-        if (data_len < 9){
-            return ESP_ERR_INVALID_SIZE;
-        }
-
-        header->data_len = (uint16_t)data[6] | ((uint16_t)data[7] << 8);
-
-        if (header->data_len > data_len){
-            ESP_LOGE(DEBUG_LINK_TAG, "Mismatch data length in control frame");
-            return ESP_ERR_INVALID_RESPONSE;
-        }
-
-        if (header->data_len == 0){
-            ESP_LOGE(DEBUG_LINK_TAG, "Data len 0");
-            return ESP_ERR_INVALID_SIZE;
-        }
-
-        *message_size = header->data_len;
-
-        if (*message_size > MAX_CONTROL_DATA_LEN || (10 + *message_size > data_len)){
-            ESP_LOGE(DEBUG_LINK_TAG, "Invalid payload length: %u", *message_size);
-            return ESP_ERR_INVALID_SIZE;
-        }
-
-        memcpy(message, &data[8], header->data_len);
-
-        geneate_crc_16(data, 8*sizeof(uint8_t) + header->data_len, &header->crc_16);
-
-        uint16_t crc_calc = ((uint16_t)data[8 + header->data_len] | ((uint16_t)data[9 + header->data_len] << 8));
-
-        if (crc_calc != header->crc_16){
-            //CRC mismatch
-            ESP_LOGE(DEBUG_LINK_TAG, "CRC Mismatch - Control Frame");
-            ESP_LOGE(DEBUG_LINK_TAG, "Got 0x%04X but calculated 0x%04X\n", crc_calc, header->crc_16);
-            return ESP_ERR_INVALID_CRC;
-        }
-
-    } else {
-        //generic frame
-
-        if (data_len < 13){
-            return ESP_ERR_INVALID_SIZE;
-        }
-
-        uint16_t total_frag = (uint16_t)data[6] | ((uint16_t)data[7] << 8);
-        uint16_t frag_num = (uint16_t)data[8] | ((uint16_t)data[9] << 8);
-        header->frag_info = (total_frag << 16) | (frag_num);
-        header->data_len = (uint16_t)data[10] | ((uint16_t)data[11] << 8);
-
-        *message_size = header->data_len;
-
-        if ((*message_size > MAX_GENERIC_DATA_LEN && total_frag != 1) || (14 + *message_size > data_len)){
-            ESP_LOGE(DEBUG_LINK_TAG, "Invalid payload length: %u", *message_size);
-            return ESP_ERR_INVALID_SIZE;
-        }
-
-        memcpy(message, &data[12], *message_size);
-
-        if (total_frag != 1){
-            geneate_crc_16(data, 12*sizeof(uint8_t) + *message_size, &header->crc_16);
-        } else {
-            header->crc_16 = 0;
-        }
-
-        uint16_t crc_calc = ((uint16_t)data[12 + *message_size] | ((uint16_t)data[13 + *message_size] << 8));
-
-        if (crc_calc != header->crc_16 && total_frag != 1){
-            //CRC mismatch
-            ESP_LOGE(DEBUG_LINK_TAG, "CRC Mismatch - Generic Frame");
-            ESP_LOGE(DEBUG_LINK_TAG, "Got 0x%04X but calculated 0x%04X\n", crc_calc, header->crc_16);
-            return ESP_ERR_INVALID_CRC;
-        }
+    FrameView frame;
+    esp_err_t res = parse_frame(data, data_len, &frame);
+    if (res != ESP_OK){
+        return res;
     }
 
+    *header = frame.header;
+    *message_size = frame.header.data_len;
+    memcpy(message, frame.data, *message_size);
+
     // printf("Received Frame Information:\n");
     // printf("%-10s %-12s %-13s %-15s %-12s %-10s %-6s\n",
     // "Preamble", "Sender ID", "Receiver ID", "Sequence Num", "Type+Flag", "Data Len", "CRC");
@@ -606,7 +458,7 @@ esp_err_t DataLinkManager::get_data_from_frame(uint8_t* data, size_t data_len, u
 }
 
 /**
- * @brief This function implements the CRC-16/CCITT algorithm
+ * @brief This function implements the CRC-16/CCITT algorithm (see `crc16_update` for the engine used)
  *
  * @param data
  * @param data_len
@@ -622,12 +474,7 @@ esp_err_t DataLinkManager::geneate_crc_16(uint8_t* data, size_t data_len, uint16
         return ESP_FAIL; //fail if the data len is 0
     }
 
-    *crc = 0x0;
-
-    for (size_t i = 0; i < data_len; i++){
-        uint8_t tbl_idx = (*crc >> 8) ^ data[i];
-        *crc = (*crc << 8) ^ crc16_table[tbl_idx];
-    }
+    *crc = crc16_update(CRC16_INIT, data, data_len);
 
     return ESP_OK;
 }
@@ -0,0 +1,326 @@
+#include "DataLinkManager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <cstring>
+
+/**
+ * @brief Store a fragment that has been received. The payload is copied straight from the RX buffer to its offset in
+ * the reassembled data
+ *
+ * @param fragment Fragment parsed in place (see `parse_frame`)
+ * @param channel Channel the fragment came in on (the ACK goes back through it)
+ * @return esp_err_t ESP_ERR_NO_MEM if the first fragment of a frame does not fit in `REASSEMBLY_MAX_BYTES`
+ */
+esp_err_t DataLinkManager::store_fragment(const FrameView& fragment, uint8_t channel){
+    const FrameHeader& header = fragment.header;
+    uint16_t total_frag = (header.frag_info >> 16) & 0xFFFF;
+    uint16_t frag_num = header.frag_info & 0xFFFF;
+    size_t fragment_len = frame_sizing.max_generic_data_len; //every fragment but the last is full (see `scheduler_send_fragment`)
+
+    if (header.data_len == 0 || total_frag == 0 || frag_num == 0 || frag_num > total_frag){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (header.data_len > fragment_len || (frag_num < total_frag && header.data_len != fragment_len)){
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (header.receiver_id != this_board_id && header.receiver_id != BROADCAST_ADDR){
+        //fragments for other boards are forwarded before getting here (see `forward_frame`)
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "got frame %d, fragment %d of %d", header.seq_num, frag_num, total_frag);
+
+    if (reassembly_mutex == NULL){
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreTake(reassembly_mutex, pdMS_TO_TICKS(REASSEMBLY_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    bool acked = static_cast<FrameType>(GET_TYPE(header.type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE;
+    int64_t now = esp_timer_get_time();
+    auto entry = reassembly_map.find(get_reassembly_key(header.sender_id, header.seq_num));
+    if (entry == reassembly_map.end() && reassembly_was_completed(get_reassembly_key(header.sender_id, header.seq_num), total_frag)){
+        //resent because the ACK of the last fragment was lost: ack the whole frame again rather than reassembling it
+        //a second time (the sender would never get past the partial copy)
+        if (acked){
+            reassembly_stats.reacked++;
+        }
+        xSemaphoreGive(reassembly_mutex);
+        return acked ? queue_fragment_ack(header, channel, total_frag, 0) : ESP_OK;
+    }
+
+    if (entry == reassembly_map.end()){
+        size_t bitmap_words = (total_frag + FRAGMENT_BITMAP_WORD_BITS - 1) / FRAGMENT_BITMAP_WORD_BITS;
+        size_t budget_bytes = total_frag * fragment_len + bitmap_words * sizeof(uint32_t) + sizeof(FragmentMetadata);
+        esp_err_t res = reassembly_reserve(budget_bytes);
+        if (res != ESP_OK){
+            xSemaphoreGive(reassembly_mutex);
+            return res;
+        }
+
+        entry = reassembly_map.try_emplace(get_reassembly_key(header.sender_id, header.seq_num)).first;
+        FragmentMetadata& metadata = entry->second;
+        metadata.data = std::make_unique<std::vector<uint8_t>>(total_frag * fragment_len);
+        metadata.received.assign(bitmap_words, 0);
+        metadata.header = header;
+        metadata.total_frags = total_frag;
+        metadata.num_fragments_rx = 0;
+        metadata.data_len = 0;
+        metadata.budget_bytes = budget_bytes;
+        reassembly_stats.bytes_in_use += budget_bytes;
+    }
+
+    FragmentMetadata& metadata = entry->second;
+    if (total_frag != metadata.total_frags){
+        xSemaphoreGive(reassembly_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    metadata.last_rx_us = now; //resent fragments keep the frame alive too
+    if (!is_fragment_received(metadata, frag_num)){
+        memcpy(&metadata.data->data()[(frag_num - 1) * fragment_len], fragment.data, header.data_len);
+        set_fragment_received(metadata, frag_num);
+        metadata.num_fragments_rx++;
+        if (frag_num == total_frag){
+            metadata.data_len = (total_frag - 1) * fragment_len + header.data_len;
+        }
+        // ESP_LOGI(DEBUG_LINK_TAG, "store frame %d fragment %d success; got %d out of %d", header.seq_num, frag_num, metadata.num_fragments_rx, total_frag);
+    }
+
+    uint16_t last_consec_rx_frag = 0;
+    uint32_t sack = 0; //fragments received past the first missing one, so the sender only resends the missing ones
+    if (acked){
+        while (last_consec_rx_frag < total_frag && is_fragment_received(metadata, last_consec_rx_frag + 1)){
+            last_consec_rx_frag++;
+        }
+
+        for (uint16_t i = 0; i < GENERIC_FRAG_ACK_SACK_BITS && last_consec_rx_frag + 2 + i <= total_frag; i++){
+            if (is_fragment_received(metadata, last_consec_rx_frag + 2 + i)){
+                sack |= 1UL << i;
+            }
+        }
+    }
+
+    bool complete = metadata.num_fragments_rx == metadata.total_frags;
+    xSemaphoreGive(reassembly_mutex);
+
+    if (acked){
+        esp_err_t res = queue_fragment_ack(header, channel, last_consec_rx_frag, sack);
+        if (res != ESP_OK){
+            return res;
+        }
+    }
+
+    if (complete){
+        return complete_fragment(header.sender_id, header.seq_num);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Queues the ACK of a fragment for the send ACK thread
+ *
+ * @param header Header of the fragment
+ * @param channel Channel the fragment came in on
+ * @param last_ack Last fragment received in a row
+ * @param sack Fragments received past the first missing one (see `FrameAckRecord`)
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::queue_fragment_ack(const FrameHeader& header, uint8_t channel, uint16_t last_ack, uint32_t sack){
+    uint16_t total_frag = (header.frag_info >> 16) & 0xFFFF;
+    SendAckMetaData data = {
+        .data = {GENERIC_FRAG_ACK_PREAMBLE, static_cast<uint8_t>((last_ack & 0xFF00) >> 8), static_cast<uint8_t>(last_ack & 0xFF),
+        static_cast<uint8_t>((total_frag & 0xFF00) >> 8), static_cast<uint8_t>(total_frag & 0xFF),
+        static_cast<uint8_t>((header.seq_num & 0xFF00) >> 8), static_cast<uint8_t>(header.seq_num & 0xFF),
+        static_cast<uint8_t>(sack >> 24), static_cast<uint8_t>(sack >> 16), static_cast<uint8_t>(sack >> 8), static_cast<uint8_t>(sack)},
+        .sender_id = header.sender_id,
+    };
+    if (xSemaphoreTake(pending_acks_mutex[channel], pdMS_TO_TICKS(SEND_ACK_MUTEX_WAIT)) != pdTRUE){
+        return ESP_FAIL;
+    }
+
+    //the ACK of an earlier fragment of this frame, if not sent yet, is outdated by this one
+    pending_acks[channel][get_pending_ack_key(header.sender_id, header.seq_num)] = data;
+    xSemaphoreGive(pending_acks_mutex[channel]);
+
+    if (send_ack_task != NULL){
+        xTaskNotifyGive(send_ack_task);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Whether the frame `key` of `total_frags` fragments is one of the last `REASSEMBLY_COMPLETED_HISTORY` frames
+ * completed. Call with `reassembly_mutex` held
+ *
+ * @param key `get_reassembly_key`
+ * @param total_frags
+ * @return true
+ * @return false
+ */
+bool DataLinkManager::reassembly_was_completed(uint32_t key, uint16_t total_frags){
+    for (const CompletedFrame& completed : reassembly_completed){
+        if (completed.total_frags != 0 && completed.key == key && completed.total_frags == total_frags){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Makes room for a new partial frame of `budget_bytes` under `REASSEMBLY_MAX_BYTES`, dropping the partial
+ * frames that went the longest without a new fragment first. Call with `reassembly_mutex` held
+ *
+ * @param budget_bytes
+ * @return esp_err_t ESP_ERR_NO_MEM if the frame does not fit in the budget on its own
+ */
+esp_err_t DataLinkManager::reassembly_reserve(size_t budget_bytes){
+    if (budget_bytes > REASSEMBLY_MAX_BYTES){
+        reassembly_stats.rejected++;
+        ESP_LOGE(DEBUG_LINK_TAG, "Frame of %d B is larger than the reassembly budget", budget_bytes);
+        return ESP_ERR_NO_MEM;
+    }
+
+    while (reassembly_stats.bytes_in_use + budget_bytes > REASSEMBLY_MAX_BYTES && !reassembly_map.empty()){
+        auto oldest = reassembly_map.begin();
+        for (auto it = reassembly_map.begin(); it != reassembly_map.end(); ++it){
+            if (it->second.last_rx_us < oldest->second.last_rx_us){
+                oldest = it;
+            }
+        }
+
+        ESP_LOGW(DEBUG_LINK_TAG, "Dropped frame %d from board %d (%d of %d fragments) to make room", oldest->second.header.seq_num,
+                 oldest->second.header.sender_id, oldest->second.num_fragments_rx, oldest->second.total_frags);
+        reassembly_stats.bytes_in_use -= oldest->second.budget_bytes;
+        reassembly_stats.evicted++;
+        reassembly_map.erase(oldest);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Drops the partial frames that went `REASSEMBLY_TIMEOUT_MS` without a new fragment (eg. the sender gave up or
+ * lost a `MISC_UDP_GENERIC_TYPE` fragment). Does nothing until `REASSEMBLY_SWEEP_PERIOD_MS` passed since the last
+ * sweep. Called by the send ACK thread
+ *
+ */
+void DataLinkManager::reassembly_sweep(){
+    int64_t now = esp_timer_get_time();
+    if (now - reassembly_last_sweep_us < REASSEMBLY_SWEEP_PERIOD_MS * 1000){
+        return;
+    }
+    reassembly_last_sweep_us = now;
+
+    if (reassembly_mutex == NULL || xSemaphoreTake(reassembly_mutex, pdMS_TO_TICKS(REASSEMBLY_MUTEX_WAIT_MS)) != pdTRUE){
+        return;
+    }
+
+    for (auto it = reassembly_map.begin(); it != reassembly_map.end();){
+        if (now - it->second.last_rx_us < REASSEMBLY_TIMEOUT_MS * 1000){
+            ++it;
+            continue;
+        }
+
+        ESP_LOGW(DEBUG_LINK_TAG, "Frame %d from board %d timed out with %d of %d fragments", it->second.header.seq_num,
+                 it->second.header.sender_id, it->second.num_fragments_rx, it->second.total_frags);
+        reassembly_stats.bytes_in_use -= it->second.budget_bytes;
+        reassembly_stats.timed_out++;
+        it = reassembly_map.erase(it);
+    }
+
+    xSemaphoreGive(reassembly_mutex);
+}
+
+/**
+ * @brief Removes the corresponding entry from `reassembly_map` and pushes its data onto `async_receive_queue` (moved,
+ * not copied)
+ *
+ * @param sender_id
+ * @param sequence_num
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::complete_fragment(uint8_t sender_id, uint16_t sequence_num){
+    if (reassembly_mutex == NULL){
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreTake(reassembly_mutex, pdMS_TO_TICKS(REASSEMBLY_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    auto entry = reassembly_map.find(get_reassembly_key(sender_id, sequence_num));
+    if (entry == reassembly_map.end()){
+        xSemaphoreGive(reassembly_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FragmentMetadata& metadata = entry->second;
+    if (metadata.num_fragments_rx != metadata.total_frags){
+        xSemaphoreGive(reassembly_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "completing %d fragments for frame %d", metadata.num_fragments_rx, sequence_num);
+
+    //only the last fragment may be short, so this drops the unused tail without reallocating
+    metadata.data->resize(metadata.data_len);
+
+    Rx_Metadata rx;
+    rx.header = metadata.header;
+    rx.header.frag_info = (uint32_t)(metadata.total_frags << 16) | 1;
+    rx.header.data_len = metadata.data_len;
+    rx.header.crc_16 = 0;
+    rx.data_len = metadata.data_len;
+    rx.data = std::move(metadata.data);
+
+    reassembly_stats.bytes_in_use -= metadata.budget_bytes;
+    reassembly_stats.completed++;
+    reassembly_completed[reassembly_completed_next] = {
+        .key = entry->first,
+        .total_frags = metadata.total_frags,
+    };
+    reassembly_completed_next = (reassembly_completed_next + 1) % REASSEMBLY_COMPLETED_HISTORY;
+    reassembly_map.erase(entry);
+
+    xSemaphoreGive(reassembly_mutex);
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "pushing frame %d onto async rx queue", sequence_num);
+
+    if (!async_receive_queue->enqueue(std::move(rx), std::chrono::milliseconds(ASYNC_QUEUE_WAIT_TICKS))) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "frame %d pushed success", sequence_num);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Fetches the counters of the reassembly of generic frames
+ *
+ * @param stats
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::get_reassembly_stats(ReassemblyStats* stats){
+    if (stats == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (reassembly_mutex == NULL || xSemaphoreTake(reassembly_mutex, pdMS_TO_TICKS(REASSEMBLY_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    *stats = reassembly_stats;
+    stats->num_partial = reassembly_map.size();
+    xSemaphoreGive(reassembly_mutex);
+
+    return ESP_OK;
+}
@@ -5,27 +5,51 @@
 #include "esp_timer.h"
 #include "freertos/projdefs.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "esp_random.h"
 #include "portmacro.h"
 
 #define FRAME_DEQUEUE_TIMEOUT_MS 2000
 #define FRAME_ENQUEUE_TIMEOUT_MS 50
 
+static void frame_gap_timer_callback(void* args){
+    xSemaphoreGive(static_cast<SemaphoreHandle_t>(args));
+}
+
 void DataLinkManager::init_scheduler(){
     for (int i = 0; i < num_channels; i++){
         async_rx_queue_mutex[i] = xSemaphoreCreateMutex();
-        rx_fragment_mutex[i] = xSemaphoreCreateMutex();
         sliding_window_mutex[i] = xSemaphoreCreateMutex();
-        send_ack_queue_mutex[i] = xSemaphoreCreateMutex();
+        pending_acks_mutex[i] = xSemaphoreCreateMutex();
+
+        frame_gap_done[i] = xSemaphoreCreateBinary();
+        esp_timer_create_args_t gap_timer_args = {
+            .callback = frame_gap_timer_callback,
+            .arg = static_cast<void*>(frame_gap_done[i]),
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "FrameGap",
+            .skip_unhandled_events = true,
+        };
+        if (frame_gap_done[i] == NULL || esp_timer_create(&gap_timer_args, &frame_gap_timers[i]) != ESP_OK){
+            ESP_LOGE(DEBUG_LINK_TAG, "Failed to create the frame gap timer of channel %d, gaps will be a whole tick", i);
+            frame_gap_timers[i] = nullptr;
+        }
 
         ESP_LOGI(DEBUG_LINK_TAG, "Starting Frame Scheduler task for channel %d", i);
         auto args = (frame_scheduler_args*)malloc(sizeof(frame_scheduler_args));
         args->channel_id = i;
         args->that = this;
-        xTaskCreate(DataLinkManager::frame_scheduler, "Scheduler", 4096, static_cast<void*>(args), 4, &scheduler_task);
+        xTaskCreate(DataLinkManager::frame_scheduler, "Scheduler", SCHEDULER_TASK_STACK_SIZE, static_cast<void*>(args), 4, &scheduler_tasks[i]);
+
+        rx_buffers[i] = std::make_unique<uint8_t[]>(frame_sizing.max_burst_size);
+
+        ESP_LOGI(DEBUG_LINK_TAG, "Starting Receive task for channel %d", i);
+        auto rx_args = (frame_scheduler_args*)malloc(sizeof(frame_scheduler_args));
+        rx_args->channel_id = i;
+        rx_args->that = this;
+        xTaskCreate(DataLinkManager::receive_thread_main, "Receiver", RECEIVE_TASK_STACK_SIZE, static_cast<void*>(rx_args), 5, &receive_tasks[i]);
     }
 
-    xTaskCreate(DataLinkManager::receive_thread_main, "Receiver", 8192, static_cast<void*>(this), 5, &receive_task);
     xTaskCreate(DataLinkManager::send_ack_thread_main, "Send ACKs", 8192, static_cast<void*>(this), 5, &send_ack_task);
 }
 
@@ -33,10 +57,12 @@ void DataLinkManager::init_scheduler(){
  * @brief Schedules which frame to send
  *
  * Scheduler:
- * - All frames will be pushed to the back onto a queue
- * - When a generic frame sends a chunk, it will be pushed back to the queue for the next chunk to be sent
- *
- * Scheduling may change (above scheduler will lead to starvation of control frames depending on the number of generic frames/fragments to send)
+ * - Frames are pushed to the lock-free TX ring of the channel, which the scheduler drains into the FIFO of their
+ *   class (`SchedulerClass`)
+ * - Generic frames that need fragmenting go to the transmit state table of the channel instead, which the scheduler
+ *   walks to send their fragments (see `scheduler_walk_tx_table`)
+ * - Control frames go first (bounded by `SCHEDULER_MAX_CONTROL_RUN`), RIP/ACK/generic frames share the rest with
+ *   deficit round-robin, so neither side can starve the other
  */
 [[noreturn]] void DataLinkManager::frame_scheduler(void* args){
     const auto parsed_args = static_cast<frame_scheduler_args*>(args);
@@ -45,6 +71,7 @@ void DataLinkManager::init_scheduler(){
 
     if (link_layer_obj == nullptr){
         ESP_LOGE(DEBUG_LINK_TAG, "Frame Scheduler failed to start due to invalid pointer");
+        free(args);
         vTaskDelete(nullptr);
     }
 
@@ -53,11 +80,14 @@ void DataLinkManager::init_scheduler(){
         link_layer_obj->scheduler_send(channel);
     }
     free(args);
+    //deleted by the destructor once suspended (see `stop_task`)
+    vTaskSuspend(nullptr);
     vTaskDelete(nullptr);
 }
 
 /**
- * @brief Pushes a frame to the scheduler
+ * @brief Pushes a frame to the scheduler of `channel`. Safe from any task: the frame goes through the lock-free TX
+ * ring of the channel and the scheduler task is notified
  *
  * @param frame
  * @param channel
@@ -80,10 +110,21 @@ esp_err_t DataLinkManager::push_frame_to_scheduler(SchedulerMetadata frame, uint
         return ESP_ERR_INVALID_ARG;
     }
 
-    int64_t now = esp_timer_get_time();
-    frame.enqueue_time_ns = now;
+    frame.enqueue_time_ns = esp_timer_get_time();
 
-    frame_queue[channel]->enqueue(std::move(frame), std::chrono::milliseconds(FRAME_ENQUEUE_TIMEOUT_MS));
+    TickType_t start = xTaskGetTickCount();
+    while (!tx_ring[channel]->try_push(frame)){
+        //the scheduler is behind (or paused by `train_link`) - back off rather than spin
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(FRAME_ENQUEUE_TIMEOUT_MS)){
+            ESP_LOGE(DEBUG_LINK_TAG, "Scheduler TX ring on channel %d is full", channel);
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
+
+    if (scheduler_tasks[channel] != NULL){
+        xTaskNotifyGive(scheduler_tasks[channel]);
+    }
 
     // ESP_LOGI(DEBUG_LINK_TAG, "Pushed frame to queue on channel %d", channel);
 
@@ -91,7 +132,65 @@ esp_err_t DataLinkManager::push_frame_to_scheduler(SchedulerMetadata frame, uint
 }
 
 /**
- * @brief Scheduler sending the actual frame at the top of the heap on a channel
+ * @brief Queues `frame` in its class FIFO of `channel` (see `SchedulerClass`). Scheduler task of `channel` only
+ *
+ * @param frame Left untouched if the class is full
+ * @param channel
+ * @return esp_err_t ESP_ERR_NO_MEM if the class is full
+ */
+esp_err_t DataLinkManager::scheduler_enqueue(SchedulerMetadata& frame, uint8_t channel){
+    //cost (for DRR) is the size of the next frame sent from this entry: a single fragment for large generic frames
+    size_t data_len = frame.data->size();
+    size_t cost = data_len;
+    if (IS_CONTROL_FRAME(frame.header.type_flag)){
+        cost += CONTROL_FRAME_OVERHEAD;
+    } else {
+        cost = (data_len < frame_sizing.max_generic_data_len ? data_len : frame_sizing.max_generic_data_len) + GENERIC_FRAME_OVERHEAD;
+    }
+
+    size_t frame_class = static_cast<size_t>(get_scheduler_class(frame.header));
+    int64_t deadline = frame.deadline_us != 0 ? frame.deadline_us : INT64_MAX; //no deadline goes after every deadline
+    uint32_t key = frame.coalesce_key;
+    if (!frame_queue[channel]->push(std::move(frame), frame_class, cost, deadline, key)){
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Moves the frames pushed to the TX ring of `channel` into their class FIFOs, or into the transmit state table
+ * for generic frames that need fragmenting. Stops at the first frame that does not fit, it stays in the ring until
+ * the scheduler sent some frames of its class (or finished a fragmented frame)
+ *
+ * @param channel
+ */
+void DataLinkManager::scheduler_drain_tx_ring(uint8_t channel){
+    while (SchedulerMetadata* frame = tx_ring[channel]->front()){
+        bool fragmented = !IS_CONTROL_FRAME(frame->header.type_flag) && frame->data->size() > frame_sizing.max_generic_data_len;
+        esp_err_t res = fragmented ? scheduler_add_tx_state(*frame, channel) : scheduler_enqueue(*frame, channel);
+        if (res != ESP_OK){
+            return;
+        }
+        tx_ring[channel]->pop();
+    }
+}
+
+/**
+ * @brief Scheduler sending the next frames (picked by `SchedulerClass`) on a channel
+ *
+ * Up to `SCHEDULER_MAX_BURST_FRAMES` frames that are already queued are packed back to back into a single
+ * transmission (burst) to amortize the per-transmission overhead. Only the first frame of a burst is waited for: the
+ * scheduler sleeps on its task notification until a frame is pushed to the TX ring.
+ *
+ * Fragments of generic frames come from the transmit state table of the channel (`generic_tx`). They take turns with
+ * the frames of the class queue, but control frames still go first (at most `SCHEDULER_MAX_CONTROL_RUN` in a row
+ * while fragments are due).
+ *
+ * There is no fixed pacing: a burst goes out as soon as the previous transmission on the channel is done (plus
+ * `SCHEDULER_MIN_FRAME_GAP_US`, see `scheduler_open_burst`). If only fragments waiting on ACKs are left, the
+ * scheduler sleeps until the first retransmission timer expires, an ACK moves a window or a new frame is pushed
+ *
+ * Control frames whose deadline has passed are dropped instead of sent
  *
  * @return esp_err_t
  */
@@ -101,17 +200,90 @@ esp_err_t DataLinkManager::scheduler_send(uint8_t channel){
         return ESP_ERR_INVALID_ARG;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(10));  // the messages cannot be too close together
+    if (link_training[channel].initiating){
+        //frames stay queued until the channel settles on a bit rate (see `train_link`)
+        vTaskDelay(pdMS_TO_TICKS(SCHEDULER_TRAINING_POLL_MS));
+        return ESP_OK;
+    }
 
-    SchedulerMetadata frame;
+    GenericTxTable& table = generic_tx[channel];
+    SchedulerBurst burst = {};
+    esp_err_t res = ESP_OK;
+    bool sent = false;
+    bool table_idle = false; //no fragment was due on the last walk of the table
+    int64_t next_due_us = INT64_MAX; //earliest retransmission timer of the table
+
+    scheduler_drain_tx_ring(channel);
+    if (frame_queue[channel]->size() == 0 && table.num_active == 0){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FRAME_DEQUEUE_TIMEOUT_MS));
+        scheduler_drain_tx_ring(channel);
+    }
 
-    if (auto maybe_frame = frame_queue[channel]->dequeue(std::chrono::milliseconds(FRAME_DEQUEUE_TIMEOUT_MS))) {
-        frame = *maybe_frame;
-    } else {
-        // ESP_LOGI(DEBUG_LINK_TAG, "Scheduler queue for channel %d is empty", channel);
-        return ESP_OK;
+    for (uint8_t i = 0; i < SCHEDULER_MAX_BURST_FRAMES; i++){
+        bool control_first = frame_queue[channel]->size(static_cast<size_t>(SchedulerClass::CONTROL)) > 0
+            && table.control_run < SCHEDULER_MAX_CONTROL_RUN;
+        if (!table_idle && table.num_active > 0 && ((table.fragment_turn && !control_first) || frame_queue[channel]->size() == 0)){
+            bool fragment_sent = false;
+            res = scheduler_walk_tx_table(channel, &burst, &fragment_sent, &next_due_us);
+            if (res != ESP_OK){
+                table.fragment_turn = false;
+                break;
+            }
+            if (fragment_sent){
+                sent = true;
+                table.fragment_turn = false;
+                table.control_run = 0;
+                continue;
+            }
+            table_idle = true;
+        }
+
+        auto maybe_frame = frame_queue[channel]->pop();
+        if (!maybe_frame){
+            // ESP_LOGI(DEBUG_LINK_TAG, "Scheduler queue for channel %d is empty", channel);
+            break;
+        }
+
+        table.fragment_turn = true;
+        if (IS_CONTROL_FRAME(maybe_frame->header.type_flag) && table.control_run < SCHEDULER_MAX_CONTROL_RUN){
+            table.control_run++;
+        }
+
+        if (maybe_frame->deadline_us != 0 && maybe_frame->deadline_us < esp_timer_get_time()){
+            //stale - sending it would only delay the frames behind it
+            ESP_LOGD(DEBUG_LINK_TAG, "Dropped expired frame to board %d on channel %d", maybe_frame->header.receiver_id, channel);
+            continue;
+        }
+
+        res = scheduler_build_frame(channel, std::move(*maybe_frame), &burst);
+        if (res != ESP_OK){
+            break;
+        }
+        sent = true;
     }
 
+    esp_err_t flush_res = scheduler_flush_burst(&burst);
+
+    if (!sent && next_due_us != INT64_MAX){
+        int64_t wait_us = next_due_us - esp_timer_get_time();
+        if (wait_us > 0){
+            TickType_t wait_ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+            ulTaskNotifyTake(pdTRUE, wait_ticks > 0 ? wait_ticks : 1);
+        }
+    }
+
+    return res != ESP_OK ? res : flush_res;
+}
+
+/**
+ * @brief Serializes a frame that fits in a single frame (control frames and small generic frames) onto `burst`
+ *
+ * @param channel Channel the frame was scheduled on
+ * @param frame
+ * @param burst
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_build_frame(uint8_t channel, SchedulerMetadata frame, SchedulerBurst* burst){
     if (frame.data == nullptr){
         ESP_LOGE(DEBUG_LINK_TAG, "Data array does not exist");
         return ESP_ERR_INVALID_ARG;
@@ -122,190 +294,503 @@ esp_err_t DataLinkManager::scheduler_send(uint8_t channel){
         return ESP_ERR_INVALID_ARG;
     }
 
-    esp_err_t res;
-    bool isControlFrame = IS_CONTROL_FRAME(static_cast<uint8_t>(frame.header.type_flag));
+    //fragmented generic frames never get here, they are sent from the transmit state table (`scheduler_walk_tx_table`)
+    esp_err_t res = scheduler_send_rmt(channel, frame.header, frame.data->data(), frame.data->size(), burst);
+    if (res != ESP_OK){
+        ESP_LOGE(DEBUG_LINK_TAG, "Failed to send %s frame", IS_CONTROL_FRAME(frame.header.type_flag) ? "control" : "generic");
+    }
+    return res;
+}
 
-    size_t frame_size = isControlFrame ? sizeof(ControlFrame) : sizeof(GenericFrame);
-    uint8_t send_data[frame_size];
+/**
+ * @brief Adds a generic frame that needs fragmenting to the transmit state table of `channel`. Scheduler task of
+ * `channel` only
+ *
+ * @param frame Left untouched if the table is full
+ * @param channel
+ * @return esp_err_t ESP_ERR_NO_MEM if the table is full
+ */
+esp_err_t DataLinkManager::scheduler_add_tx_state(SchedulerMetadata& frame, uint8_t channel){
+    GenericTxTable& table = generic_tx[channel];
+    for (GenericTxState& state : table.entries){
+        if (state.in_use){
+            continue;
+        }
 
-    if (isControlFrame){
-        //control frame
+        if (static_cast<FrameType>(GET_TYPE(frame.header.type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE){
+            esp_err_t res = open_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num, frame.header.frag_info >> 16);
+            if (res != ESP_OK){
+                return res;
+            }
+        }
 
-        res = create_control_frame(frame.data->data(), frame.data->size(),
-            make_control_frame_from_header(frame.header), send_data, &frame_size);
+        state.frame = std::move(frame);
+        state.frame.curr_fragment = 0;
+        state.frame.last_ack = 0;
+        state.frame.next_tx_us = 0;
+        state.hold_until_us = 0;
+        state.highest_sent = 0;
+        state.retries = 0;
+        state.in_use = true;
+        table.num_active++;
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
 
+/**
+ * @brief Walks the transmit state table of `channel` round-robin from its cursor and serializes the first fragment
+ * that can be sent onto `burst`. Entries that are done (all fragments ack'd) are freed on the way
+ *
+ * @param channel
+ * @param burst
+ * @param sent Set if a fragment was serialized
+ * @param next_due_us Lowered to the retransmission timer of entries waiting on ACKs
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_walk_tx_table(uint8_t channel, SchedulerBurst* burst, bool* sent, int64_t* next_due_us){
+    GenericTxTable& table = generic_tx[channel];
+    int64_t now = esp_timer_get_time();
+
+    for (uint8_t n = 0; n < SCHEDULER_TX_TABLE_SIZE; n++){
+        uint8_t i = (table.cursor + n) % SCHEDULER_TX_TABLE_SIZE;
+        GenericTxState& state = table.entries[i];
+        if (!state.in_use){
+            continue;
+        }
+
+        if (now < state.hold_until_us){
+            if (state.hold_until_us < *next_due_us){
+                *next_due_us = state.hold_until_us;
+            }
+            continue;
+        }
+
+        bool done = false;
+        esp_err_t res = scheduler_send_fragment(channel, state, now, burst, sent, &done);
+        if (done){
+            //frees the data array
+            state = {};
+            table.num_active--;
+        }
         if (res != ESP_OK){
-            ESP_LOGE(DEBUG_LINK_TAG, "Failed to create control frame");
+            //eg. no route to the receiver yet - the other frames go first, this one is tried again later
+            state.hold_until_us = now + SCHEDULER_TX_RETRY_MS * 1000;
+            table.cursor = (i + 1) % SCHEDULER_TX_TABLE_SIZE;
             return res;
         }
 
-        // ESP_LOGI(DEBUG_LINK_TAG, "Sending control frame with %d bytes", frame_size);
-        return scheduler_send_rmt(channel, frame, send_data, frame_size, false);
-    } else {
-        //generic frame
-        if (frame.data->size() > (MAX_GENERIC_DATA_LEN)){
-            //fragment here
-
-            if (frame.timeout == 0){
-                frame.timeout = GENERIC_FRAME_MIN_TIMEOUT;
-            } else {
-                frame.timeout--;
-                res = push_frame_to_scheduler(frame, channel);
-                if (res != ESP_OK){
-                    ESP_LOGE(DEBUG_LINK_TAG, "Failed to schedule next generic frame fragment");
-                    return res;
-                }
-                return ESP_OK;
-            }
+        if (*sent){
+            table.cursor = (i + 1) % SCHEDULER_TX_TABLE_SIZE; //the next walk starts with the next frame
+            return ESP_OK;
+        }
 
-            if (static_cast<FrameType>(GET_TYPE(frame.header.type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE){
-                FrameAckRecord record = {
-                    .last_ack = 0,
-                    .total_frags = 0
-                };
-
-                res = get_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num, &record);
-
-                if (res != ESP_OK){
-                    ESP_LOGE(DEBUG_LINK_TAG, "Failed to get sliding window ack record for board id %d seq num %d", frame.header.receiver_id, frame.header.seq_num);
-                    return res;
-                }
-
-                if (record.last_ack == 0 && record.total_frags == 0){
-                    //no acks has arrived yet - can only send fragment 1 ... fragment GENERIC_FRAME_SLIDING_WINDOW_SIZE (inclusive)
-                    // ESP_LOGI(DEBUG_LINK_TAG, "no ack received yet for board id %d seq num %d", frame.header.receiver_id, frame.header.seq_num);
-                    if (frame.curr_fragment < GENERIC_FRAME_SLIDING_WINDOW_SIZE){
-                        frame.curr_fragment++;
-                    } else {
-                        frame.curr_fragment = 1;
-                    }
-                } else {
-                    //some acks has arrived
-                    // ESP_LOGI(DEBUG_LINK_TAG, "some ack received for board id %d seq num %d last ack %d total frags %d", frame.header.receiver_id, frame.header.seq_num, record.last_ack, record.total_frags);
-
-                    //check if all acks are received
-                    frame.last_ack = record.last_ack;
-                    if (record.last_ack == record.total_frags){
-                        //all acks received, can simply exit
-                        // ESP_LOGI(DEBUG_LINK_TAG, "All acks recevied for board id %d seq num %d", frame.header.receiver_id, frame.header.seq_num);
-                        complete_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num);
-                        return ESP_OK;
-                    }
-
-                    if (frame.curr_fragment - frame.last_ack < GENERIC_FRAME_SLIDING_WINDOW_SIZE && frame.curr_fragment - frame.last_ack < record.total_frags){
-                        frame.curr_fragment++;
-                    } else {
-                        frame.curr_fragment = frame.last_ack;
-                    }
-                }
-            } else {
-                frame.curr_fragment++;
-            }
+        if (state.in_use && state.frame.next_tx_us < *next_due_us){
+            *next_due_us = state.frame.next_tx_us;
+        }
+    }
 
-            // ESP_LOGI(DEBUG_LINK_TAG, "current fragment to be sent for seq num %d is %d", frame.header.seq_num, frame.curr_fragment);
+    return ESP_OK;
+}
 
-            //calculate data offset from curr_fragment
-            uint16_t fragment_size = 0;
+/**
+ * @brief First fragment in [`from`, `to`] that was neither ack'd nor reported in the SACK bitmap of `record`
+ *
+ * @param record
+ * @param from
+ * @param to
+ * @return uint16_t the fragment number, 0 if they were all received
+ */
+static uint16_t next_unacked_fragment(const FrameAckRecord& record, uint16_t from, uint16_t to){
+    for (uint16_t fragment = from > record.last_ack ? from : record.last_ack + 1; fragment <= to; fragment++){
+        if (!is_fragment_sacked(record, fragment)){
+            return fragment;
+        }
+    }
+    return 0;
+}
 
-            if (frame.curr_fragment != (frame.header.frag_info >> 16)) {
-                fragment_size = MAX_GENERIC_DATA_LEN;
-            } else {
-                fragment_size = frame.data->size() - (MAX_GENERIC_DATA_LEN * (frame.curr_fragment-1));
-            }
+/**
+ * @brief Sends the next fragment of a generic frame from its transmit state, if its sliding window allows it
+ *
+ * Fragments inside the window (`GENERIC_FRAME_SLIDING_WINDOW_SIZE` past the last ack'd one) are sent back to back.
+ * Once the window is full, the frame waits for ACKs to move it, or for its retransmission timer (`next_tx_us`). On
+ * a timeout only the fragments of the window the receiver did not report in its SACK bitmap are resent.
+ *
+ * The retransmission timeout comes from the RTT estimator of the receiver (`get_rtt_estimator`), fed every time an
+ * ACK moves the window: the sample is the time between sending fragment `last_ack` and the ACK arriving. Resent
+ * fragments give no sample (Karn's algorithm) and every timeout doubles the timeout until the next sample.
+ * `MISC_UDP_GENERIC_TYPE` frames are not ack'd: every fragment is sent once
+ *
+ * @param channel
+ * @param state Transmit state of the frame
+ * @param now
+ * @param burst
+ * @param sent Set if a fragment was serialized
+ * @param done Set once the frame is complete and its transmit state can be freed
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_send_fragment(uint8_t channel, GenericTxState& state, int64_t now, SchedulerBurst* burst, bool* sent, bool* done){
+    SchedulerMetadata& frame = state.frame;
+    if (frame.data == nullptr || this_board_id == PC_ADDR){
+        *done = true;
+        return ESP_ERR_INVALID_ARG;
+    }
 
-            uint16_t curr_offset = MAX_GENERIC_DATA_LEN * (frame.curr_fragment - 1);
+    esp_err_t res;
+    uint16_t total_frags = frame.header.frag_info >> 16;
+    bool acked = static_cast<FrameType>(GET_TYPE(frame.header.type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE;
+    uint16_t fragment = 0;
 
-            // ESP_LOGI(DEBUG_LINK_TAG, "frame %d curr offset %d\n", frame.header.seq_num, curr_offset);
-            // ESP_LOGI(DEBUG_LINK_TAG, "frame %d fragment size %d\n", frame.header.seq_num, fragment_size);
+    if (acked){
+        FrameAckRecord record = {
+            .last_ack = 0,
+            .total_frags = 0
+        };
 
-            frame.header.frag_info = (frame.header.frag_info & 0xFFFF0000) | frame.curr_fragment; //increment frag_num
-            //create fragment
-            res = create_generic_frame(frame.data->data(), fragment_size,
-                make_generic_frame_from_header(frame.header), curr_offset, send_data, &frame_size);
+        res = get_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num, &record);
+        if (res != ESP_OK){
+            ESP_LOGE(DEBUG_LINK_TAG, "Failed to get sliding window ack record for board id %d seq num %d", frame.header.receiver_id, frame.header.seq_num);
+            return res;
+        }
 
-            if (res != ESP_OK){
-                ESP_LOGE(DEBUG_LINK_TAG, "Failed to create generic frame fragment");
-                return res;
-            }
+        if (record.last_ack >= total_frags){
+            //all acks received
+            // ESP_LOGI(DEBUG_LINK_TAG, "All acks recevied for board id %d seq num %d", frame.header.receiver_id, frame.header.seq_num);
+            complete_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num, true);
+            *done = true;
+            return ESP_OK;
+        }
 
-            res = scheduler_send_rmt(channel, frame, send_data, frame_size, true);
+        if (record.last_ack != frame.last_ack){
+            state.retries = 0; //the receiver is still there
+        }
 
-            if (res != ESP_OK){
-                ESP_LOGE(DEBUG_LINK_TAG, "Failed to send generic frame fragment");
-                res = push_frame_to_scheduler(frame, channel);
-                if (res != ESP_OK){
-                    ESP_LOGE(DEBUG_LINK_TAG, "Failed to schedule next generic frame fragment");
-                }
-                return res;
+        if (record.last_ack > frame.last_ack){
+            //the window moved
+            int64_t sent_us = state.sent_us[(record.last_ack - 1) % GENERIC_FRAME_SLIDING_WINDOW_SIZE];
+            if (sent_us != 0 && record.ack_us > sent_us){
+                RttEstimator rtt = get_rtt_estimator(channel, frame.header.receiver_id);
+                rtt_add_sample(&rtt, record.ack_us - sent_us);
+                set_rtt_estimator(channel, frame.header.receiver_id, rtt);
             }
-
-            //need to schedule the next fragment (if total_frags != frag_num)
-            if ((frame.header.frag_info >> 16) > (frame.header.frag_info & 0xFF) || (frame.last_ack != (frame.header.frag_info >> 16) &&
-            static_cast<FrameType>(GET_TYPE(frame.header.type_flag)) != FrameType::MISC_UDP_GENERIC_TYPE)){
-                // frame.generic_frame_data_offset += fragment_size;
-                // ESP_LOGI(DEBUG_LINK_TAG, "scheduling frame %d with frag_info 0x%X", frame.header.seq_num, frame.header.frag_info);
-                res = push_frame_to_scheduler(frame, channel);
-                if (res != ESP_OK){
-                    ESP_LOGE(DEBUG_LINK_TAG, "Failed to schedule next generic frame fragment");
-                    return res;
-                }
-            } else {
-                //Done fragmenting, can free data array
-                // ESP_LOGI(DEBUG_LINK_TAG, "finished fragmenting seq num %d frag_info 0x%X", frame.header.seq_num, frame.header.frag_info);
+            frame.last_ack = record.last_ack;
+            if (frame.curr_fragment < frame.last_ack){
+                frame.curr_fragment = frame.last_ack;
             }
+        } else if (record.last_ack < frame.last_ack){
+            //the receiver dropped the partial frame (evicted or timed out, see `reassembly_reserve`) and started over:
+            //go back to what it still has instead of waiting on fragments it will never ACK
+            ESP_LOGW(DEBUG_LINK_TAG, "Board %d went back from fragment %d to %d of frame %d, resending", frame.header.receiver_id,
+                     frame.last_ack, record.last_ack, frame.header.seq_num);
+            frame.last_ack = record.last_ack;
+            frame.curr_fragment = record.last_ack;
+            state.resend_fragment = 0;
+        }
 
-        } else {
-            //no fragmenting
-            res = create_generic_frame(frame.data->data(), frame.data->size(),
-                make_generic_frame_from_header(frame.header), 0, send_data, &frame_size);
+        if (state.resend_fragment != 0){
+            //resending after a timeout - skips what was ack'd or SACK'd since
+            fragment = next_unacked_fragment(record, state.resend_fragment, frame.curr_fragment);
+            state.resend_fragment = 0;
+        }
 
-            if (res != ESP_OK){
-                ESP_LOGE(DEBUG_LINK_TAG, "Failed to create generic frame");
-                return res;
+        bool window_open = frame.curr_fragment < total_frags && frame.curr_fragment - frame.last_ack < GENERIC_FRAME_SLIDING_WINDOW_SIZE;
+        if (fragment == 0 && !window_open){
+            if (now < frame.next_tx_us){
+                return ESP_OK; //waiting on ACKs
             }
-            return scheduler_send_rmt(channel, frame, send_data, frame_size, false);
+            if (state.retries >= GENERIC_FRAME_MAX_RETRIES){
+                //the receiver is gone (or the link is down): give up rather than hold the entry forever
+                ESP_LOGE(DEBUG_LINK_TAG, "Dropped frame %d to board %d after %d retransmissions (%d of %d fragments ack'd)", frame.header.seq_num,
+                         frame.header.receiver_id, state.retries, frame.last_ack, total_frags);
+                complete_record_sliding_window(channel, frame.header.receiver_id, frame.header.seq_num, false);
+                *done = true;
+                return ESP_OK;
+            }
+            state.retries++;
+
+            //retransmission timeout - resend the fragments of the window that did not make it
+            fragment = next_unacked_fragment(record, frame.last_ack + 1, frame.curr_fragment);
+            RttEstimator rtt = get_rtt_estimator(channel, frame.header.receiver_id);
+            rtt_backoff(&rtt);
+            set_rtt_estimator(channel, frame.header.receiver_id, rtt);
         }
     }
 
+    if (fragment == 0){
+        fragment = frame.curr_fragment + 1;
+    }
+
+    //calculate data offset from the fragment number
+    uint16_t fragment_size = 0;
+    size_t curr_offset = frame_sizing.max_generic_data_len * (fragment - 1);
+
+    if (fragment != total_frags) {
+        fragment_size = frame_sizing.max_generic_data_len;
+    } else {
+        fragment_size = frame.data->size() - curr_offset;
+    }
+
+    FrameHeader header = frame.header;
+    header.frag_info = (header.frag_info & 0xFFFF0000) | fragment;
+    //the fragment is serialized straight from its slice of the data
+    res = scheduler_send_rmt(channel, header, &frame.data->data()[curr_offset], fragment_size, burst);
+    if (res != ESP_OK){
+        //the state is left as is, the same fragment is tried again on the next walk
+        ESP_LOGE(DEBUG_LINK_TAG, "Failed to send generic frame fragment");
+        return res;
+    }
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "Sent fragment %d of %d for seq num %d", fragment, total_frags, frame.header.seq_num);
+    *sent = true;
+    frame.header.frag_info = header.frag_info;
+    int64_t& sent_us = state.sent_us[(fragment - 1) % GENERIC_FRAME_SLIDING_WINDOW_SIZE];
+    if (fragment > frame.curr_fragment){
+        frame.curr_fragment = fragment;
+        sent_us = fragment > state.highest_sent ? now : 0; //sent again after the receiver went back, no RTT sample
+        state.highest_sent = fragment > state.highest_sent ? fragment : state.highest_sent;
+    } else {
+        state.resend_fragment = fragment + 1; //the rest of the window is checked on the next walk
+        sent_us = 0;
+    }
+
+    if (acked){
+        frame.next_tx_us = now + get_rtt_estimator(channel, frame.header.receiver_id).rto_us;
+    }
+
+    if (!acked && fragment == total_frags){
+        //Done fragmenting, can free data array
+        *done = true;
+    }
     return ESP_OK;
 }
 
-esp_err_t DataLinkManager::scheduler_send_rmt(uint8_t channel, SchedulerMetadata frame, uint8_t* send_data, size_t frame_size, bool wait_for_tx_done){
+/**
+ * @brief Serializes a frame (`header` and `payload_len` bytes of `payload`) at the end of `burst`. The burst is
+ * transmitted first if the frame is routed to another channel or does not fit
+ *
+ * @param channel Channel the frame was scheduled on (used for broadcasts)
+ * @param header
+ * @param payload
+ * @param payload_len
+ * @param burst
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_send_rmt(uint8_t channel, const FrameHeader& header, const uint8_t* payload, uint16_t payload_len, SchedulerBurst* burst){
     esp_err_t res;
-    uint8_t channel_to_route = MAX_CHANNELS;
-    rmt_transmit_config_t config = {
-        .loop_count = 0,
-        .flags = {
-            .eot_level = 0,   // typically 0 or 1, depending on your output idle level
-        }
-    };
-    if (frame.header.receiver_id == BROADCAST_ADDR){
-        // printf("Sending on channel %d\n", i);
-        res = phys_comms->send(send_data, frame_size, &config, channel);
-    } else {
-        res = route_frame(frame.header.receiver_id, &channel_to_route);
+    uint8_t channel_to_route = channel;
+    if (header.receiver_id != BROADCAST_ADDR){
+        res = route_frame(header.receiver_id, &channel_to_route);
 
         if (res != ESP_OK){
-            ESP_LOGE(DEBUG_LINK_TAG, "Failed to find entry for %d", frame.header.receiver_id);
+            ESP_LOGE(DEBUG_LINK_TAG, "Failed to find entry for %d", header.receiver_id);
             return ESP_FAIL;
         }
-        // ESP_LOGI(DEBUG_LINK_TAG, "Sending frame %d frag_info 0x%X", frame.header.seq_num, frame.header.frag_info);
-        res = phys_comms->send(send_data, frame_size, &config, channel_to_route);
-        // if (wait_for_tx_done){
-        //     phys_comms->wait_until_send_complete(channel_to_route);
-        // }
     }
 
+    size_t header_size = IS_CONTROL_FRAME(header.type_flag) ? CONTROL_FRAME_HEADER_SIZE : GENERIC_FRAME_HEADER_SIZE;
+    size_t frame_size = header_size + payload_len + FRAME_CRC_SIZE;
+    if (frame_size > frame_sizing.max_burst_size){
+        ESP_LOGE(DEBUG_LINK_TAG, "Frame of size %d does not fit in a transmission", frame_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (burst->data != nullptr && (burst->channel != channel_to_route || burst->length + frame_size > burst->capacity)){
+        res = scheduler_flush_burst(burst);
+        if (res != ESP_OK){
+            return res;
+        }
+    }
+
+    if (burst->data == nullptr){
+        res = scheduler_open_burst(channel_to_route, burst);
+        if (res != ESP_OK){
+            return res;
+        }
+    }
+
+    // ESP_LOGI(DEBUG_LINK_TAG, "Sending frame %d frag_info 0x%X", header.seq_num, header.frag_info);
+    res = write_frame(header, payload, payload_len, &burst->data[burst->length], burst->capacity - burst->length, &frame_size);
+    if (res != ESP_OK){
+        return res;
+    }
+    burst->length += frame_size;
+    burst->num_frames++;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Hands the next TX slot of `channel` to `burst` once the channel has been idle for `SCHEDULER_MIN_FRAME_GAP_US`.
+ * Holds `phys_tx_mutex` of `channel` until the burst is flushed
+ *
+ * @param channel
+ * @param burst
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_open_burst(uint8_t channel, SchedulerBurst* burst){
+    if (xSemaphoreTake(phys_tx_mutex[channel], pdMS_TO_TICKS(PHYS_TX_MUTEX_WAIT_MS)) != pdTRUE){
+        //the responder of a link training can switch the bit rate from the receive thread
+        return ESP_ERR_TIMEOUT;
+    }
+
+    wait_frame_gap(channel);
+
+    uint8_t* slot = nullptr;
+    size_t capacity = 0;
+    esp_err_t res = phys_comms->acquire_tx_slot(channel, &slot, &capacity);
+    if (res != ESP_OK){
+        xSemaphoreGive(phys_tx_mutex[channel]);
+        ESP_LOGE(DEBUG_LINK_TAG, "No TX slot on channel %d", channel);
+        return res;
+    }
+
+    burst->data = slot;
+    burst->capacity = capacity < frame_sizing.max_burst_size ? capacity : frame_sizing.max_burst_size;
+    burst->length = 0;
+    burst->channel = channel;
+    burst->num_frames = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Transmits all the frames of `burst` in a single transmission and empties it. Returns once the transmission
+ * has left the wire, so the next burst is sent as soon as the channel is idle
+ *
+ * @param burst
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::scheduler_flush_burst(SchedulerBurst* burst){
+    if (burst->data == nullptr){
+        return ESP_OK;
+    }
+
+    if (burst->length > 0){
+        scheduler_piggyback_acks(burst);
+    }
+
+    //an empty burst gives the slot back without transmitting
+    esp_err_t res = phys_comms->commit_tx_slot(burst->channel, burst->length);
+    if (res == ESP_OK && burst->length > 0){
+        wait_tx_done(burst->channel);
+    }
+    xSemaphoreGive(phys_tx_mutex[burst->channel]);
+
+    burst->data = nullptr;
+    burst->capacity = 0;
+    burst->length = 0;
+    burst->num_frames = 0;
+
     if (res != ESP_OK){
         ESP_LOGE(DEBUG_LINK_TAG, "Failed to send message");
         return ESP_FAIL;
-    } else{
-        // ESP_LOGI(DEBUG_LINK_TAG, "Sent frame %d frag_info 0x%X", frame.header.seq_num, frame.header.frag_info);
     }
 
     return ESP_OK;
 }
 
+/**
+ * @brief Packs the pending ACKs (see `pending_acks`) to the neighbour of `burst` into the space left in it, so they
+ * ride along with data already going that way instead of waiting for a transmission of their own. ACKs that do not
+ * fit are left to the send ACK thread
+ *
+ * @param burst Open burst with at least one frame
+ */
+void DataLinkManager::scheduler_piggyback_acks(SchedulerBurst* burst){
+    const size_t ack_frame_size = GENERIC_FRAME_HEADER_SIZE + GENERIC_FRAG_ACK_DATA_SIZE + FRAME_CRC_SIZE;
+
+    for (uint8_t channel = 0; channel < num_channels; channel++){
+        if (burst->length + ack_frame_size > burst->capacity){
+            return;
+        }
+
+        //never wait on the receive thread while holding the channel
+        if (xSemaphoreTake(pending_acks_mutex[channel], 0) != pdTRUE){
+            continue;
+        }
+
+        for (auto it = pending_acks[channel].begin(); it != pending_acks[channel].end();){
+            if (burst->length + ack_frame_size > burst->capacity){
+                break;
+            }
+
+            uint8_t channel_to_route = 0;
+            uint16_t seq_num = 0;
+            if (route_frame(it->second.sender_id, &channel_to_route) != ESP_OK || channel_to_route != burst->channel ||
+                get_inc_sequence_num(it->second.sender_id, &seq_num) != ESP_OK){
+                ++it;
+                continue;
+            }
+
+            FrameHeader header = {
+                .preamble = START_OF_FRAME,
+                .sender_id = this_board_id,
+                .receiver_id = it->second.sender_id,
+                .seq_num = seq_num,
+                .type_flag = static_cast<uint8_t>(FrameType::ACK_TYPE),
+                .frag_info = 1 << 16,
+                .data_len = GENERIC_FRAG_ACK_DATA_SIZE,
+                .crc_16 = 0,
+            };
+
+            size_t frame_size = 0;
+            if (write_frame(header, it->second.data, GENERIC_FRAG_ACK_DATA_SIZE, &burst->data[burst->length],
+                            burst->capacity - burst->length, &frame_size) != ESP_OK){
+                break;
+            }
+            burst->length += frame_size;
+            burst->num_frames++;
+            it = pending_acks[channel].erase(it);
+        }
+
+        xSemaphoreGive(pending_acks_mutex[channel]);
+    }
+}
+
+/**
+ * @brief Blocks until the transmissions on `channel` have left the wire (signalled by the TX done interrupt of the
+ * PHY) and records when. Call with `phys_tx_mutex` of `channel` held
+ *
+ * @param channel
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::wait_tx_done(uint8_t channel){
+    esp_err_t res = phys_comms->wait_until_send_complete(channel);
+    last_tx_done_us[channel] = esp_timer_get_time();
+    return res;
+}
+
+/**
+ * @brief Blocks until `channel` has been idle for `SCHEDULER_MIN_FRAME_GAP_US` since its last transmission. Returns
+ * right away on a channel that has been idle for longer. The gap is shorter than a tick, so the task sleeps on a one
+ * shot `esp_timer` rather than `vTaskDelay`. Call with `phys_tx_mutex` of `channel` held
+ *
+ * @param channel
+ */
+void DataLinkManager::wait_frame_gap(uint8_t channel){
+    int64_t gap_end_us = last_tx_done_us[channel] + SCHEDULER_MIN_FRAME_GAP_US;
+    int64_t now = esp_timer_get_time();
+    if (now >= gap_end_us){
+        return;
+    }
+
+    if (frame_gap_timers[channel] == nullptr){
+        vTaskDelay(1);
+        return;
+    }
+
+    xSemaphoreTake(frame_gap_done[channel], 0); //left by a timer that fired after its wait gave up
+    while (now < gap_end_us){
+        if (esp_timer_start_once(frame_gap_timers[channel], gap_end_us - now) != ESP_OK){
+            vTaskDelay(1);
+        } else if (xSemaphoreTake(frame_gap_done[channel], pdMS_TO_TICKS((gap_end_us - now) / 1000) + 1) != pdTRUE){
+            //the timer task is late - the gap is over anyway
+            esp_timer_stop(frame_gap_timers[channel]);
+        }
+        now = esp_timer_get_time();
+    }
+}
+
 /**
  * @brief Increases the head of the sliding window associated with the board id and sequence number
  *
@@ -321,7 +806,8 @@ esp_err_t DataLinkManager::inc_head_sliding_window(uint8_t channel, uint8_t boar
     }
 
     if (ack_record->total_frags == 0 || ack_record->total_frags > MAX_GENERIC_NUM_FRAG
-        || ack_record->last_ack == 0 || ack_record->total_frags < ack_record->last_ack){
+        || (ack_record->last_ack == 0 && ack_record->sack == 0) || ack_record->total_frags < ack_record->last_ack){
+        //an ACK with no fragment ack'd yet still reports the fragments received past the first (lost) one
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -333,20 +819,37 @@ esp_err_t DataLinkManager::inc_head_sliding_window(uint8_t channel, uint8_t boar
         return ESP_ERR_TIMEOUT;
     }
 
-    FrameAckRecord& record = sliding_window[channel][board_id][seq_num];
-
-    if (record.last_ack > ack_record->last_ack){
+    auto entry = sliding_window[channel][board_id].find(seq_num);
+    if (entry == sliding_window[channel][board_id].end() || entry->second.total_frags != ack_record->total_frags){
+        //eg. an ACK repeated for a frame that is already complete - records are only opened by `scheduler_add_tx_state`
         xSemaphoreGive(sliding_window_mutex[channel]);
-        return ESP_ERR_INVALID_ARG;
+        return ESP_ERR_NOT_FOUND;
     }
+    FrameAckRecord& record = entry->second;
 
-    record.last_ack = ack_record->last_ack;
-    if (record.total_frags == 0){
-        record.total_frags = ack_record->total_frags;
+    if (ack_record->last_ack < record.last_ack){
+        //the receiver lost the fragments it had ack'd (its partial frame was evicted or timed out): its ACKs start
+        //over, so what it reported before is no longer true (`scheduler_send_fragment` goes back to `last_ack`)
+        record.sack = ack_record->sack;
+        record.last_ack = ack_record->last_ack;
+    } else {
+        //fragments reported by an earlier ACK stay received
+        if (ack_record->last_ack > record.last_ack){
+            uint16_t shift = ack_record->last_ack - record.last_ack;
+            record.sack = shift < GENERIC_FRAG_ACK_SACK_BITS ? record.sack >> shift : 0;
+            record.ack_us = esp_timer_get_time(); //RTT sample of fragment `last_ack` (see `scheduler_send_fragment`)
+        }
+        record.sack |= ack_record->sack;
+        record.last_ack = ack_record->last_ack;
     }
 
     xSemaphoreGive(sliding_window_mutex[channel]);
 
+    if (scheduler_tasks[channel] != NULL){
+        //the window moved - the scheduler may be sleeping on the retransmission timer of this frame
+        xTaskNotifyGive(scheduler_tasks[channel]);
+    }
+
     return ESP_OK;
 }
 
@@ -377,6 +880,8 @@ esp_err_t DataLinkManager::get_record_sliding_window(uint8_t channel, uint8_t bo
         xSemaphoreGive(sliding_window_mutex[channel]);
         ack_record->last_ack = 0;
         ack_record->total_frags = 0;
+        ack_record->sack = 0;
+        ack_record->ack_us = 0;
         return ESP_OK;
     }
 
@@ -384,6 +889,40 @@ esp_err_t DataLinkManager::get_record_sliding_window(uint8_t channel, uint8_t bo
 
     ack_record->last_ack = record.last_ack;
     ack_record->total_frags = record.total_frags;
+    ack_record->sack = record.sack;
+    ack_record->ack_us = record.ack_us;
+
+    xSemaphoreGive(sliding_window_mutex[channel]);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Opens the record of a generic frame about to be fragmented, which its ACKs then update (ACKs for frames
+ * without a record are dropped, so a repeated ACK of a completed frame does not leave a record behind)
+ *
+ * @param channel
+ * @param board_id Receiving Board ID
+ * @param seq_num
+ * @param total_frags
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::open_record_sliding_window(uint8_t channel, uint8_t board_id, uint16_t seq_num, uint16_t total_frags){
+    if (sliding_window_mutex[channel] == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (xSemaphoreTake(sliding_window_mutex[channel], pdMS_TO_TICKS(SLIDING_WINDOW_MUTEX_TIMEOUT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    sliding_window[channel][board_id][seq_num] = {
+        .last_ack = 0,
+        .total_frags = total_frags,
+        .seq_num = seq_num,
+        .sack = 0,
+        .ack_us = 0,
+    };
 
     xSemaphoreGive(sliding_window_mutex[channel]);
 
@@ -396,9 +935,10 @@ esp_err_t DataLinkManager::get_record_sliding_window(uint8_t channel, uint8_t bo
  * @param channel
  * @param board_id Receiving Board ID (the board who ACK'd)
  * @param seq_num
+ * @param delivered Whether every fragment was ack'd, or the frame was given up on (counted in `generic_tx_stats`)
  * @return esp_err_t
  */
-esp_err_t DataLinkManager::complete_record_sliding_window(uint8_t channel, uint8_t board_id, uint16_t seq_num){
+esp_err_t DataLinkManager::complete_record_sliding_window(uint8_t channel, uint8_t board_id, uint16_t seq_num, bool delivered){
     if (sliding_window_mutex[channel] == NULL){
         return ESP_ERR_INVALID_STATE;
     }
@@ -414,7 +954,102 @@ esp_err_t DataLinkManager::complete_record_sliding_window(uint8_t channel, uint8
     }
 
     sliding_window[channel][board_id].erase(seq_num);
+    if (delivered){
+        generic_tx_stats[channel].completed++;
+    } else {
+        generic_tx_stats[channel].failed++;
+    }
+
+    xSemaphoreGive(sliding_window_mutex[channel]);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief RTT estimator of `board_id` for the frames the scheduler of `channel` sends (a copy, see `set_rtt_estimator`)
+ *
+ * @param channel
+ * @param board_id Receiving Board ID
+ * @return RttEstimator The initial estimator if there is no sample yet (or the mutex timed out)
+ */
+RttEstimator DataLinkManager::get_rtt_estimator(uint8_t channel, uint8_t board_id){
+    RttEstimator rtt;
+    rtt_init(&rtt);
+
+    if (sliding_window_mutex[channel] == NULL ||
+        xSemaphoreTake(sliding_window_mutex[channel], pdMS_TO_TICKS(SLIDING_WINDOW_MUTEX_TIMEOUT_MS)) != pdTRUE){
+        return rtt;
+    }
+
+    auto entry = rtt_estimators[channel].find(board_id);
+    if (entry != rtt_estimators[channel].end()){
+        rtt = entry->second;
+    }
+
+    xSemaphoreGive(sliding_window_mutex[channel]);
+    return rtt;
+}
+
+/**
+ * @brief Stores the RTT estimator of `board_id` after a sample or a timeout. Scheduler task of `channel` only (it
+ * is the only writer, so a `get_rtt_estimator` -> update -> `set_rtt_estimator` loses nothing)
+ *
+ * @param channel
+ * @param board_id Receiving Board ID
+ * @param rtt
+ */
+void DataLinkManager::set_rtt_estimator(uint8_t channel, uint8_t board_id, const RttEstimator& rtt){
+    if (sliding_window_mutex[channel] == NULL ||
+        xSemaphoreTake(sliding_window_mutex[channel], pdMS_TO_TICKS(SLIDING_WINDOW_MUTEX_TIMEOUT_MS)) != pdTRUE){
+        return;
+    }
+
+    rtt_estimators[channel][board_id] = rtt;
+    xSemaphoreGive(sliding_window_mutex[channel]);
+}
+
+/**
+ * @brief Round trip time estimate and retransmission timeout of the generic frames sent to `board_id` on `channel`
+ *
+ * @param channel
+ * @param board_id Receiving Board ID
+ * @param rtt `srtt_us` is 0 until the first sample
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::get_rtt_stats(uint8_t channel, uint8_t board_id, RttEstimator* rtt){
+    if (rtt == nullptr || channel >= num_channels){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (sliding_window_mutex[channel] == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    *rtt = get_rtt_estimator(channel, board_id);
+    return ESP_OK;
+}
+
+/**
+ * @brief Fetches the counters of the ack'd generic frames sent on `channel`
+ *
+ * @param channel
+ * @param stats
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::get_generic_tx_stats(uint8_t channel, GenericTxStats* stats){
+    if (stats == nullptr || channel >= num_channels){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (sliding_window_mutex[channel] == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (xSemaphoreTake(sliding_window_mutex[channel], pdMS_TO_TICKS(SLIDING_WINDOW_MUTEX_TIMEOUT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
 
+    *stats = generic_tx_stats[channel];
     xSemaphoreGive(sliding_window_mutex[channel]);
 
     return ESP_OK;
@@ -0,0 +1,476 @@
+#include "DataLinkManager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/**
+ * @brief Probe filler: 0x00/0xFF are all half bit pulses and 0x55/0xAA are all full bit pulses once Manchester encoded
+ *
+ */
+static const uint8_t link_training_probe_pattern[] = {0x00, 0xFF, 0x55, 0xAA};
+
+static void serialize_link_training_message(const LinkTrainingMessage& message, uint8_t* data){
+    data[0] = static_cast<uint8_t>(message.op);
+    data[1] = static_cast<uint8_t>(message.line_code);
+    data[2] = message.bit_rate & 0xFF;
+    data[3] = (message.bit_rate >> 8) & 0xFF;
+    data[4] = (message.bit_rate >> 16) & 0xFF;
+    data[5] = (message.bit_rate >> 24) & 0xFF;
+    data[6] = message.count & 0xFF;
+    data[7] = (message.count >> 8) & 0xFF;
+}
+
+static bool parse_link_training_message(const uint8_t* data, size_t data_len, LinkTrainingMessage* message){
+    if (data_len < LINK_TRAINING_MESSAGE_SIZE){
+        return false;
+    }
+
+    message->op = static_cast<LinkTrainingOp>(data[0]);
+    message->line_code = static_cast<LineCode>(data[1]);
+    message->bit_rate = (uint32_t)data[2] | ((uint32_t)data[3] << 8) | ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 24);
+    message->count = (uint16_t)data[6] | ((uint16_t)data[7] << 8);
+    return true;
+}
+
+/**
+ * @brief Whether `message` refers to the trial the responder is running
+ *
+ */
+static bool is_current_trial(const LinkTrainingState* state, const LinkTrainingMessage& message){
+    return state->trial_bit_rate != 0 && state->trial_bit_rate == message.bit_rate && state->trial_line_code == message.line_code;
+}
+
+void DataLinkManager::init_link_training(){
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < num_channels; i++){
+        phys_tx_mutex[i] = xSemaphoreCreateMutex();
+        link_training_replies[i] = xQueueCreate(LINK_TRAINING_REPLY_QUEUE_SIZE, sizeof(LinkTrainingMessage));
+
+        uint32_t base_bit_rate = phys_comms->get_bit_rate(i);
+        LineCode base_line_code = phys_comms->get_line_code(i);
+        link_training[i].base_bit_rate = base_bit_rate;
+        link_training[i].good_bit_rate = base_bit_rate;
+        link_training[i].trial_bit_rate = 0;
+        link_training[i].base_line_code = base_line_code;
+        link_training[i].good_line_code = base_line_code;
+        link_training[i].trial_line_code = base_line_code;
+        link_training[i].probes_rx = 0;
+        link_training[i].deadline_us = 0;
+        link_training[i].last_rx_us = now;
+        link_training[i].initiating = false;
+        link_training[i].neighbour_id = 0;
+    }
+
+    if (train_on_discovery){
+        xTaskCreate(DataLinkManager::link_training_task_main, "LinkTraining", LINK_TRAINING_TASK_STACK_SIZE, static_cast<void*>(this), 5, &link_training_task);
+    }
+}
+
+/**
+ * @brief Called when RIP learns `neighbour_id` one hop away on `channel` (on the receive thread of `channel`). The
+ * first time a neighbour is seen on a channel, the board with the lower id trains the link, so only one end does
+ *
+ * @param channel
+ * @param neighbour_id
+ */
+void DataLinkManager::request_link_training(uint8_t channel, uint8_t neighbour_id){
+    LinkTrainingState* state = &link_training[channel];
+    if (link_training_task == NULL || state->neighbour_id == neighbour_id){
+        return;
+    }
+
+    state->neighbour_id = neighbour_id;
+    if (this_board_id > neighbour_id){
+        return; //the neighbour trains the link, this board responds
+    }
+
+    link_training_requests.fetch_or(1 << channel);
+    xTaskNotifyGive(link_training_task);
+}
+
+/**
+ * @brief Trains the links to the neighbours RIP learnt (see `request_link_training`). `train_link` blocks for a few
+ * seconds and needs the receive thread of the channel for the replies, so it runs here rather than on the receive thread
+ *
+ * @param args DataLinkManager
+ */
+[[noreturn]] void DataLinkManager::link_training_task_main(void* args){
+    DataLinkManager* link_layer_obj = static_cast<DataLinkManager*>(args);
+    if (link_layer_obj == nullptr){
+        ESP_LOGE(DEBUG_LINK_TAG, "Link training task failed to start due to invalid pointer");
+        vTaskDelete(nullptr);
+    }
+
+    ESP_LOGI(DEBUG_LINK_TAG, "Starting link training task");
+
+    while(!link_layer_obj->stop_tasks){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (link_layer_obj->stop_tasks){
+            break;
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LINK_TRAINING_DISCOVERY_DELAY_MS)); //cut short by the destructor
+        uint8_t requests = link_layer_obj->link_training_requests.exchange(0);
+        for (uint8_t i = 0; i < link_layer_obj->num_channels && !link_layer_obj->stop_tasks; i++){
+            if (!(requests & (1 << i))){
+                continue;
+            }
+
+            uint32_t bit_rate = 0;
+            if (link_layer_obj->train_link(i, &bit_rate) != ESP_OK){
+                ESP_LOGE(DEBUG_LINK_TAG, "Failed to train channel %d", i);
+            }
+        }
+    }
+    //deleted by the destructor once suspended (see `stop_task`)
+    vTaskSuspend(nullptr);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief Switches `channel` to `link_training_line_code` (if the neighbour on that channel supports it) then steps its
+ * bit rate up through `link_training_bit_rates`, and settles on the fastest bit rate where enough probe frames pass
+ * the CRC
+ *
+ * @note Blocks for a few seconds. The scheduler of `channel` is paused meanwhile. Only one end of a link should train it
+ * (started by `request_link_training` when RIP learns a neighbour, if `train_on_discovery` is set)
+ *
+ * @param channel
+ * @param bit_rate Bit rate the channel settled on (will be written)
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::train_link(uint8_t channel, uint32_t* bit_rate){
+    if (phys_comms == nullptr || channel >= num_channels){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    LinkTrainingState* state = &link_training[channel];
+    if (state->initiating || state->trial_bit_rate != 0){
+        ESP_LOGE(DEBUG_LINK_TAG, "Channel %d is already being trained", channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    state->initiating = true;
+    xQueueReset(link_training_replies[channel]);
+
+    if (state->good_line_code != link_training_line_code && phys_comms->supports_bit_rate(link_training_line_code, state->good_bit_rate)){
+        //a failed trial keeps the current line code
+        link_training_step(channel, link_training_line_code, state->good_bit_rate);
+    }
+
+    for (uint32_t next_bit_rate : link_training_bit_rates){
+        if (stop_tasks){
+            break; //the object is going away
+        }
+
+        if (next_bit_rate <= state->good_bit_rate || !phys_comms->supports_bit_rate(state->good_line_code, next_bit_rate)){
+            continue;
+        }
+
+        if (link_training_step(channel, state->good_line_code, next_bit_rate) != ESP_OK){
+            break;
+        }
+    }
+
+    state->initiating = false;
+
+    ESP_LOGI(DEBUG_LINK_TAG, "Channel %d trained to %lu bps (line code %d)", channel, (unsigned long)state->good_bit_rate,
+        static_cast<int>(state->good_line_code));
+    if (bit_rate != nullptr){
+        *bit_rate = state->good_bit_rate;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Runs a single trial with the neighbour on `channel` (see `LinkTrainingOp`)
+ *
+ * @param channel
+ * @param line_code
+ * @param bit_rate
+ * @return esp_err_t `ESP_OK` if both ends committed to `line_code` and `bit_rate`
+ */
+esp_err_t DataLinkManager::link_training_step(uint8_t channel, LineCode line_code, uint32_t bit_rate){
+    LinkTrainingState* state = &link_training[channel];
+    LinkTrainingMessage reply = {};
+
+    esp_err_t res = send_link_training_frame(channel, {LinkTrainingOp::PROPOSE, line_code, bit_rate, 0}, LINK_TRAINING_MESSAGE_SIZE);
+    if (res == ESP_OK){
+        res = link_training_wait_reply(channel, LinkTrainingOp::ACCEPT, line_code, bit_rate, &reply);
+    }
+
+    if (res == ESP_OK){
+        res = set_link_mode(channel, line_code, bit_rate);
+    }
+
+    if (res == ESP_OK){
+        vTaskDelay(pdMS_TO_TICKS(LINK_TRAINING_SETTLE_MS));
+
+        for (uint16_t i = 0; i < LINK_TRAINING_NUM_PROBES; i++){
+            //probes that do not make it are what is being measured
+            send_link_training_frame(channel, {LinkTrainingOp::PROBE, line_code, bit_rate, i}, frame_sizing.max_control_data_len);
+        }
+
+        res = send_link_training_frame(channel, {LinkTrainingOp::PROBE_END, line_code, bit_rate, LINK_TRAINING_NUM_PROBES}, LINK_TRAINING_MESSAGE_SIZE);
+    }
+
+    if (res == ESP_OK){
+        res = link_training_wait_reply(channel, LinkTrainingOp::REPORT, line_code, bit_rate, &reply);
+    }
+
+    if (res == ESP_OK && reply.count * 100 < LINK_TRAINING_NUM_PROBES * LINK_TRAINING_MIN_PASS_PERCENT){
+        ESP_LOGW(DEBUG_LINK_TAG, "Only %d/%d probes passed at %lu bps (line code %d) on channel %d", reply.count, LINK_TRAINING_NUM_PROBES,
+            (unsigned long)bit_rate, static_cast<int>(line_code), channel);
+        res = ESP_ERR_INVALID_CRC;
+    }
+
+    if (res != ESP_OK){
+        //back to the last committed trial. The responder does the same once it stops hearing from this board
+        set_link_mode(channel, state->good_line_code, state->good_bit_rate);
+        vTaskDelay(pdMS_TO_TICKS(2 * LINK_TRAINING_TIMEOUT_MS));
+        return res;
+    }
+
+    for (uint8_t i = 0; i < LINK_TRAINING_COMMIT_REPEATS; i++){
+        send_link_training_frame(channel, {LinkTrainingOp::COMMIT, line_code, bit_rate, 0}, LINK_TRAINING_MESSAGE_SIZE);
+    }
+
+    state->good_line_code = line_code;
+    state->good_bit_rate = bit_rate;
+    return ESP_OK;
+}
+
+/**
+ * @brief Waits up to `LINK_TRAINING_TIMEOUT_MS` for the `op` reply about the trial of `line_code` at `bit_rate`.
+ * Other (stale) replies are dropped
+ *
+ * @param channel
+ * @param op
+ * @param line_code
+ * @param bit_rate
+ * @param reply
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::link_training_wait_reply(uint8_t channel, LinkTrainingOp op, LineCode line_code, uint32_t bit_rate, LinkTrainingMessage* reply){
+    int64_t deadline_us = esp_timer_get_time() + LINK_TRAINING_TIMEOUT_MS * 1000LL;
+
+    while (true){
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0){
+            return ESP_ERR_TIMEOUT;
+        }
+
+        if (xQueueReceive(link_training_replies[channel], reply, pdMS_TO_TICKS(remaining_us / 1000) + 1) != pdTRUE){
+            return ESP_ERR_TIMEOUT;
+        }
+
+        if (reply->op == op && reply->line_code == line_code && reply->bit_rate == bit_rate){
+            return ESP_OK;
+        }
+    }
+}
+
+/**
+ * @brief Sends a link training message straight to the physical layer of `channel` (bypassing the scheduler, as the
+ * bit rate is switched right after some of them)
+ *
+ * @param channel
+ * @param message
+ * @param data_len Data length of the control frame. Bytes after the message are filled with `link_training_probe_pattern`
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::send_link_training_frame(uint8_t channel, const LinkTrainingMessage& message, size_t data_len){
+    if (data_len < LINK_TRAINING_MESSAGE_SIZE || data_len > frame_sizing.max_control_data_len){
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    std::vector<uint8_t> data(data_len); //sized at runtime, `data_len` is bounded by the PHY MTU rather than `MAX_FRAME_SIZE`
+    serialize_link_training_message(message, data.data());
+    for (size_t i = LINK_TRAINING_MESSAGE_SIZE; i < data_len; i++){
+        data[i] = link_training_probe_pattern[i % sizeof(link_training_probe_pattern)];
+    }
+
+    uint16_t seq_num = 0;
+    esp_err_t res = get_inc_sequence_num(BROADCAST_ADDR, &seq_num);
+    if (res != ESP_OK){
+        return res;
+    }
+
+    FrameHeader header = {
+        .preamble = START_OF_FRAME,
+        .sender_id = this_board_id,
+        .receiver_id = BROADCAST_ADDR,
+        .seq_num = seq_num,
+        .type_flag = MAKE_TYPE_FLAG(static_cast<uint8_t>(FrameType::LINK_TRAINING_CONTROL), 0),
+        .frag_info = 0,
+        .data_len = static_cast<uint16_t>(data_len),
+        .crc_16 = 0,
+    };
+
+    if (xSemaphoreTake(phys_tx_mutex[channel], pdMS_TO_TICKS(PHYS_TX_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    wait_frame_gap(channel);
+
+    //serialized straight into the TX slot of the PHY
+    uint8_t* slot = nullptr;
+    size_t capacity = 0;
+    res = phys_comms->acquire_tx_slot(channel, &slot, &capacity);
+    if (res == ESP_OK){
+        size_t frame_size = 0;
+        res = write_frame(header, data.data(), data_len, slot, capacity, &frame_size);
+        esp_err_t commit_res = phys_comms->commit_tx_slot(channel, res == ESP_OK ? frame_size : 0); //0 gives the slot back
+        if (res == ESP_OK && commit_res == ESP_OK){
+            //back to back training frames are paced like the scheduler (see `wait_frame_gap`)
+            wait_tx_done(channel);
+        }
+        res = res != ESP_OK ? res : commit_res;
+    }
+    xSemaphoreGive(phys_tx_mutex[channel]);
+
+    return res;
+}
+
+/**
+ * @brief Handles a `LINK_TRAINING_CONTROL` frame received on `channel`. Runs on the receive thread of `channel`
+ *
+ * @param channel
+ * @param data Data of the control frame
+ * @param data_len
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::handle_link_training_frame(uint8_t channel, const uint8_t* data, size_t data_len){
+    LinkTrainingMessage message = {};
+    if (!parse_link_training_message(data, data_len, &message)){
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    LinkTrainingState* state = &link_training[channel];
+    int64_t now = esp_timer_get_time();
+    esp_err_t res = ESP_OK;
+
+    switch (message.op){
+        case LinkTrainingOp::PROPOSE:
+            if (state->initiating){
+                ESP_LOGW(DEBUG_LINK_TAG, "Both ends are training channel %d - ignoring the neighbour", channel);
+                return ESP_ERR_INVALID_STATE;
+            }
+
+            if (!phys_comms->supports_bit_rate(message.line_code, message.bit_rate)){
+                //no ACCEPT - the initiator times out and stays where it is
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+
+            if (state->trial_bit_rate != 0){
+                //the initiator is proposing with the trial settings, so it committed to them (the COMMITs were lost)
+                state->good_line_code = state->trial_line_code;
+                state->good_bit_rate = state->trial_bit_rate;
+            }
+
+            res = send_link_training_frame(channel, {LinkTrainingOp::ACCEPT, message.line_code, message.bit_rate, 0}, LINK_TRAINING_MESSAGE_SIZE);
+            if (res == ESP_OK){
+                res = set_link_mode(channel, message.line_code, message.bit_rate);
+            }
+            if (res != ESP_OK){
+                //the initiator switches anyway - none of its probes get through and it comes back to the last committed trial
+                return res;
+            }
+
+            state->trial_line_code = message.line_code;
+            state->trial_bit_rate = message.bit_rate;
+            state->probes_rx = 0;
+            state->deadline_us = now + LINK_TRAINING_TIMEOUT_MS * 1000LL;
+            return ESP_OK;
+
+        case LinkTrainingOp::PROBE:
+            if (is_current_trial(state, message)){
+                state->probes_rx++;
+                state->deadline_us = now + LINK_TRAINING_TIMEOUT_MS * 1000LL;
+            }
+            return ESP_OK;
+
+        case LinkTrainingOp::PROBE_END:
+            if (!is_current_trial(state, message)){
+                return ESP_OK;
+            }
+            state->deadline_us = now + LINK_TRAINING_TIMEOUT_MS * 1000LL;
+            return send_link_training_frame(channel, {LinkTrainingOp::REPORT, message.line_code, message.bit_rate, state->probes_rx},
+                LINK_TRAINING_MESSAGE_SIZE);
+
+        case LinkTrainingOp::COMMIT:
+            if (is_current_trial(state, message)){
+                state->good_line_code = message.line_code;
+                state->good_bit_rate = message.bit_rate;
+                state->trial_bit_rate = 0;
+                ESP_LOGI(DEBUG_LINK_TAG, "Channel %d trained to %lu bps (line code %d) by the neighbour", channel, (unsigned long)message.bit_rate,
+                    static_cast<int>(message.line_code));
+            }
+            return ESP_OK;
+
+        case LinkTrainingOp::ACCEPT:
+        case LinkTrainingOp::REPORT:
+            if (state->initiating){
+                xQueueSendToBack(link_training_replies[channel], &message, 0);
+            }
+            return ESP_OK;
+    }
+
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+/**
+ * @brief Changes the line code and bit rate of `channel` once no frame is being handed to the physical layer.
+ * Nothing changes if the physical layer cannot produce `bit_rate` with `line_code`
+ *
+ * @param channel
+ * @param line_code
+ * @param bit_rate
+ * @return esp_err_t
+ */
+esp_err_t DataLinkManager::set_link_mode(uint8_t channel, LineCode line_code, uint32_t bit_rate){
+    if (xSemaphoreTake(phys_tx_mutex[channel], pdMS_TO_TICKS(PHYS_TX_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    LineCode prev_line_code = phys_comms->get_line_code(channel);
+    esp_err_t res = ESP_OK;
+    if (line_code != prev_line_code){
+        res = phys_comms->set_line_code(channel, line_code);
+    }
+
+    if (res == ESP_OK){
+        res = phys_comms->set_bit_rate(channel, bit_rate);
+        if (res != ESP_OK && line_code != prev_line_code){
+            phys_comms->set_line_code(channel, prev_line_code);
+        }
+    }
+    xSemaphoreGive(phys_tx_mutex[channel]);
+
+    return res;
+}
+
+void DataLinkManager::link_training_check(uint8_t channel){
+    LinkTrainingState* state = &link_training[channel];
+    int64_t now = esp_timer_get_time();
+
+    if (state->trial_bit_rate != 0 && now > state->deadline_us){
+        ESP_LOGW(DEBUG_LINK_TAG, "Link training timed out at %lu bps on channel %d, back to %lu bps", (unsigned long)state->trial_bit_rate,
+            channel, (unsigned long)state->good_bit_rate);
+        state->trial_bit_rate = 0;
+        set_link_mode(channel, state->good_line_code, state->good_bit_rate);
+        return;
+    }
+
+    if (!state->initiating && state->trial_bit_rate == 0 &&
+        (state->good_bit_rate != state->base_bit_rate || state->good_line_code != state->base_line_code) &&
+        now - state->last_rx_us > LINK_SILENCE_FALLBACK_MS * 1000LL){
+        //both ends stop hearing each other if they disagree on the bit rate or line code - meet again at the base ones
+        ESP_LOGW(DEBUG_LINK_TAG, "No frames on channel %d for %d ms, back to %lu bps", channel, LINK_SILENCE_FALLBACK_MS,
+            (unsigned long)state->base_bit_rate);
+        if (set_link_mode(channel, state->base_line_code, state->base_bit_rate) == ESP_OK){
+            state->good_line_code = state->base_line_code;
+            state->good_bit_rate = state->base_bit_rate;
+            state->neighbour_id = 0; //trained again once RIP hears from the neighbour
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifdef DATA_LINK
+#include <cstddef>
+#include <cstdint>
+#include "sdkconfig.h"
+
+#define CRC_POLYNOMIAL 0x1021 //CRC-16/CCITT polynomial (MSB first, no reflection)
+#define CRC16_INIT 0x0000 //initial value of a frame CRC (CRC-16/XMODEM)
+#define CRC16_SLICE_BYTES 8 //bytes folded per step by `crc16_update_slice8`
+
+/**
+ * @brief Picks the engine behind `crc16_update` at build time (eg. `target_compile_definitions(... CRC16_USE_ROM=1)`):
+ * 0 - slice-by-8 tables (default, 4 KB of flash)
+ * 1 - `esp_rom_crc16_be` from the ESP32 ROM (no tables in flash, not available on the `linux` target)
+ *
+ */
+#ifndef CRC16_USE_ROM
+#define CRC16_USE_ROM 0
+#endif
+
+/**
+ * @brief Continues the frame CRC `crc` over `data_len` bytes of `data`. Start a frame from `CRC16_INIT`, and feed its
+ * parts (eg. header then payload) in order - they do not have to be contiguous
+ *
+ * @param crc CRC of the bytes so far
+ * @param data
+ * @param data_len
+ * @return uint16_t CRC of the bytes so far followed by `data`
+ */
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t data_len);
+
+uint16_t crc16_update_bytewise(uint16_t crc, const uint8_t* data, size_t data_len);
+uint16_t crc16_update_slice8(uint16_t crc, const uint8_t* data, size_t data_len);
+#if !CONFIG_IDF_TARGET_LINUX
+uint16_t crc16_update_rom(uint16_t crc, const uint8_t* data, size_t data_len);
+#endif
+
+#endif //DATA_LINK
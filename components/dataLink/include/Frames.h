@@ -1,16 +1,30 @@
 #ifdef DATA_LINK
 #pragma once
 #include "freertos/FreeRTOS.h"
+#include "esp_err.h"
 #include <variant>
 #include <cstdint>
 #include <vector>
+#include <memory>
+
+#include "IPhysicalLayer.h"
 
 #define BROADCAST_ADDR 0xFF //used for discovery (finding the board's neighbours). this will mean the board ids will have 2^8-2 = 254 unique IDs that could be assigned
 #define PC_ADDR 0x0 //setting 0 to be the PC
 
 #define START_OF_FRAME 0xAB //0b1010_1011 - denotes the start of frame
 
-#define MAX_FRAME_SIZE 121 //Max 121B (due to rmt) - note this includes the overhead of the frame. the actual payload max depends on the frame type (eg. 121 - 9 B is the max control data length)
+#ifndef MAX_FRAME_SIZE
+#define MAX_FRAME_SIZE 1024 //Compile time ceiling of a frame, including its overhead. Frames sent are bounded by the MTU of the physical layer (see `FrameSizing`), so it only caps PHY MTUs above it. No buffer is sized by it (they follow `FrameSizing`), it can be changed with a compile definition
+#endif
+
+#ifndef MAX_BURST_SIZE
+#define MAX_BURST_SIZE PHY_MAX_MTU //Compile time ceiling of a single transmission (one or more frames back to back), the largest PHY MTU. Also bounded by the MTU of the physical layer, so a PHY MTU above `MAX_FRAME_SIZE` carries several frames per transmission
+#endif
+
+#define CONTROL_FRAME_HEADER_SIZE 8 //bytes before the data of a control frame
+#define GENERIC_FRAME_HEADER_SIZE 12 //bytes before the data of a generic frame
+#define FRAME_CRC_SIZE 2
 
 #define MAX_GENERIC_NUM_FRAG (1 << 16) // Max 2**16 Fragments can be made with a generic frame (total 2**16 *MAX_GENERIC_DATA_LEN B of data can be sent ~ 6.7 MiB)
 
@@ -27,14 +41,15 @@
 #define MAKE_TYPE_FLAG(type, flag) ((uint8_t)((type & 0xF0) | (flag & 0xF)))
 #define IS_CONTROL_FRAME(x) (((x) & 0x80) != 0)
 
-#define CONTROL_FRAME_OVERHEAD 9
-#define GENERIC_FRAME_OVERHEAD 14
+#define CONTROL_FRAME_OVERHEAD (CONTROL_FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+#define GENERIC_FRAME_OVERHEAD (GENERIC_FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
 
 #define MAX_GENERIC_DATA_LEN (MAX_FRAME_SIZE - GENERIC_FRAME_OVERHEAD)
 #define MAX_CONTROL_DATA_LEN (MAX_FRAME_SIZE - CONTROL_FRAME_OVERHEAD)
 
 //Generic Frame Fragment ACK
-#define GENERIC_FRAG_ACK_DATA_SIZE 7
+#define GENERIC_FRAG_ACK_DATA_SIZE 11
+#define GENERIC_FRAG_ACK_SACK_BITS 32 //fragments past `last_ack + 1` reported in the SACK bitmap of an ACK
 #define GENERIC_FRAG_ACK_PREAMBLE 0x69
 
 #define CONTROL_FRAME_TYPE 0x80 //if the frame type MSB is set to 1, use the control frame
@@ -46,6 +61,7 @@ enum class FrameType : uint8_t {
     DISTANCE_SENSOR_TYPE = 0xA0, //0b1010_0000
     SERVO_TYPE = 0xC0, //0b1100_0000
     MISC_CONTROL_TYPE = 0xD0, //0b1101_0000
+    LINK_TRAINING_CONTROL = 0xE0, //0b1110_0000 - link training handshake between two neighbours (see `LinkTraining.h`), never forwarded
 
     //Generic Frames
     MISC_GENERIC_TYPE = 0x00, //0b0000_0000
@@ -66,10 +82,10 @@ typedef struct _control_frame{
     uint8_t receiver_id; //receiver board id
     uint16_t seq_num; //sequence number to differentiate frames being sent from sender to receiver
     uint8_t type_flag; //(type << 4) | flag - both are 4 bits
-    uint16_t data_len; //Data Length (max 256B)
-    uint8_t data[MAX_FRAME_SIZE]; //Variable Length of Data
+    uint16_t data_len; //Data Length (max `MAX_CONTROL_DATA_LEN`)
+    uint8_t data[MAX_CONTROL_DATA_LEN]; //Variable Length of Data (capped so the struct is at most `MAX_FRAME_SIZE`)
     uint16_t crc_16; //CRC-16
-} ControlFrame; //this will have a max size of 9 + 256B = 265B
+} ControlFrame; //layout reference only, frames are serialized with `write_frame` and parsed in place with `parse_frame`
 
 typedef struct _data_link_frame{
     uint8_t preamble; //Start of Frame
@@ -79,10 +95,10 @@ typedef struct _data_link_frame{
     uint8_t type_flag; //(type << 4) | flag - both are 4 bits
     uint16_t total_frag; //total number of fragments for this sequence
     uint16_t frag_num; //current fragment number
-    uint16_t data_len; //Data Length (max 178B)
-    uint8_t data[MAX_FRAME_SIZE]; //Variable Length of Data
+    uint16_t data_len; //Data Length (max `MAX_GENERIC_DATA_LEN`)
+    uint8_t data[MAX_GENERIC_DATA_LEN]; //Variable Length of Data (capped so the struct is at most `MAX_FRAME_SIZE`)
     uint16_t crc_16; //CRC-16
-} GenericFrame; //this will have a max size of 14 + 2^8 B = 270 B
+} GenericFrame; //layout reference only, see `ControlFrame`
 #pragma pack(pop)
 
 typedef struct _header{
@@ -98,14 +114,38 @@ typedef struct _header{
 
 using Frame = std::variant<ControlFrame, GenericFrame>;
 
-ControlFrame make_control_frame_from_header(const FrameHeader& header);
-
 GenericFrame make_generic_frame_from_header(const FrameHeader& header);
 
-typedef struct _fragment_metadata {
-    std::vector<GenericFrame> fragments;
-    uint16_t num_fragments_rx;
-} FragmentMetadata;
+esp_err_t write_frame(const FrameHeader& header, const uint8_t* data, uint16_t data_len, uint8_t* buf, size_t capacity, size_t* frame_size);
+
+/**
+ * @brief A received frame parsed in place: the header plus a view of the payload inside the RX buffer
+ *
+ * @note `data` points into the buffer passed to `parse_frame` and is only valid while that buffer is
+ */
+typedef struct _frame_view {
+    FrameHeader header;
+    const uint8_t* data; //payload (`header.data_len` bytes)
+} FrameView;
+
+esp_err_t parse_frame(const uint8_t* buf, size_t buf_len, FrameView* view);
+
+/**
+ * @brief Sizes of the frames sent over a physical layer. Derived from the PHY MTU and capped by the compile time
+ * ceilings (`MAX_FRAME_SIZE`, `MAX_BURST_SIZE`)
+ *
+ * @note Both ends of a link must use the same MTU. The receiver only checks against the compile time ceilings
+ */
+typedef struct _frame_sizing {
+    size_t max_frame_size; //largest frame (overhead included) sent in a single transmission
+    size_t max_burst_size; //largest number of bytes (frames back to back) sent in a single transmission
+    size_t max_control_data_len; //largest data length of a control frame
+    size_t max_generic_data_len; //largest data length of a generic frame (fragment)
+} FrameSizing;
+
+FrameSizing make_frame_sizing(size_t phy_mtu);
+
+uint32_t get_num_fragments(const FrameSizing& sizing, size_t data_len);
 
 typedef struct _receive_metadata{
     std::unique_ptr<std::vector<uint8_t>> data;
@@ -113,4 +153,51 @@ typedef struct _receive_metadata{
     FrameHeader header;
 } Rx_Metadata;
 
+#define REPLAY_WINDOW_SIZE 64 //sequence numbers behind the highest one seen that are still checked for duplicates
+
+/**
+ * @brief Sequence numbers recently received from one sender (to one receiver), to drop duplicated and retransmitted
+ * control frames. Sequence numbers wrap at 2^16
+ *
+ */
+typedef struct _replay_window {
+    uint16_t highest; //highest sequence number seen
+    uint64_t seen; //bit i set if `highest - i` was seen
+    bool valid; //false until the first frame
+} ReplayWindow;
+
+/**
+ * @brief Records `seq_num` in `window`. Sequence numbers further behind than `REPLAY_WINDOW_SIZE` restart the window
+ * (the sender rebooted and its sequence numbers started over) rather than being dropped. A sender that rebooted soon
+ * after sending would still land inside the window, so senders start their sequence numbers at a random value (see
+ * `get_inc_sequence_num`)
+ *
+ * @param window
+ * @param seq_num
+ * @return true if `seq_num` was not seen yet
+ * @return false if it is a duplicate
+ */
+static inline bool replay_window_update(ReplayWindow* window, uint16_t seq_num){
+    int16_t ahead = static_cast<int16_t>(static_cast<uint16_t>(seq_num - window->highest));
+    if (!window->valid || ahead <= -REPLAY_WINDOW_SIZE){
+        window->highest = seq_num;
+        window->seen = 1;
+        window->valid = true;
+        return true;
+    }
+
+    if (ahead > 0){
+        window->seen = ahead < REPLAY_WINDOW_SIZE ? (window->seen << ahead) | 1 : 1;
+        window->highest = seq_num;
+        return true;
+    }
+
+    uint64_t bit = 1ULL << -ahead;
+    if (window->seen & bit){
+        return false;
+    }
+    window->seen |= bit;
+    return true;
+}
+
 #endif //DATA_LINK
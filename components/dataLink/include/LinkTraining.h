@@ -0,0 +1,76 @@
+#pragma once
+#ifdef DATA_LINK
+#include <cstdint>
+#include "Tables.h"
+#include "IPhysicalLayer.h"
+
+#define LINK_TRAINING_NUM_PROBES 32 //probe frames sent at each bit rate tried
+#define LINK_TRAINING_MIN_PASS_PERCENT 95 //min percentage of probes that must arrive with a valid CRC to keep a bit rate
+#define LINK_TRAINING_TIMEOUT_MS 500 //max wait for a reply. The responder also reverts a trial bit rate after this long without a training frame
+#define LINK_TRAINING_SETTLE_MS 200 //lets the RX of both ends switch over to a new bit rate (longer than the PHY receive timeout)
+#define LINK_TRAINING_COMMIT_REPEATS 3 //the commit is not ACK'd - repeat it so a single lost frame does not split the link
+#define LINK_TRAINING_REPLY_QUEUE_SIZE 4
+#define LINK_TRAINING_MESSAGE_SIZE 8 //op (1B) + line code (1B) + bit rate (4B) + count (2B)
+#define LINK_SILENCE_FALLBACK_MS (3 * RIP_BROADCAST_INTERVAL) //a trained channel falls back to its base bit rate after this long without a valid frame (RIP broadcasts keep links busy)
+#define LINK_TRAINING_DISCOVERY_DELAY_MS 1000 //a neighbour learnt by RIP is trained this long after (lets the RIP replies of both ends go out first)
+#define LINK_TRAINING_TASK_STACK_SIZE 4096
+#define LINK_TRAINING_STOP_WAIT_MS (4 * LINK_TRAINING_TIMEOUT_MS + 2 * LINK_TRAINING_SETTLE_MS) //longest a trial runs (two replies waited on, then the revert) before `train_link` checks if it should stop
+
+/**
+ * @brief Bit rates tried (in order) above the bit rate of a channel. Rates the PHY cannot produce with the line code of
+ * the channel are skipped (eg. 4B/5B + NRZI cannot produce 5 Mbps on the RMT)
+ *
+ */
+static const uint32_t link_training_bit_rates[] = {1600000, 2000000, 3200000, 4000000, 5000000, 6400000, 8000000};
+
+/**
+ * @brief Denser line code tried (at the current bit rate) before stepping up the bit rate
+ *
+ */
+static constexpr LineCode link_training_line_code = LineCode::NRZI_4B5B;
+
+/**
+ * @brief Link training handshake (sent in `LINK_TRAINING_CONTROL` frames to `BROADCAST_ADDR`, never forwarded)
+ *
+ * For every line code and bit rate tried (a trial):
+ * 1. Initiator sends PROPOSE with the current line code and bit rate, the responder replies ACCEPT and both switch
+ * 2. Initiator sends `LINK_TRAINING_NUM_PROBES` PROBEs then PROBE_END. The responder replies REPORT with the number of
+ * probes that passed the CRC
+ * 3. If enough probes passed, the initiator sends COMMIT and tries the next bit rate. Otherwise both ends go back to
+ * the last committed line code and bit rate (the responder once `LINK_TRAINING_TIMEOUT_MS` passes without a COMMIT)
+ */
+enum class LinkTrainingOp : uint8_t {
+    PROPOSE = 1,
+    ACCEPT = 2,
+    PROBE = 3,
+    PROBE_END = 4,
+    REPORT = 5,
+    COMMIT = 6,
+};
+
+typedef struct _link_training_message {
+    LinkTrainingOp op;
+    LineCode line_code; //line code of the trial the message refers to
+    uint32_t bit_rate; //bit rate of the trial the message refers to
+    uint16_t count; //PROBE: probe number, PROBE_END: number of probes sent, REPORT: number of probes received
+} LinkTrainingMessage;
+
+/**
+ * @brief Link training state of one channel
+ *
+ */
+typedef struct _link_training_state {
+    uint32_t base_bit_rate; //bit rate of the PHY at start up (every board starts there)
+    uint32_t good_bit_rate; //last bit rate both ends committed to
+    uint32_t trial_bit_rate; //bit rate being probed as the responder (0 if none)
+    LineCode base_line_code; //line code of the PHY at start up
+    LineCode good_line_code; //last line code both ends committed to
+    LineCode trial_line_code; //line code being probed as the responder
+    uint16_t probes_rx; //probes received during the trial
+    int64_t deadline_us; //the responder reverts to `good_bit_rate` if no training frame arrives before this
+    int64_t last_rx_us; //last valid frame received on the channel
+    volatile bool initiating; //`train_link` is running on the channel (pauses the scheduler)
+    uint8_t neighbour_id; //neighbour RIP learnt on the channel and training was started for (0 if none, cleared on a fallback to retrain)
+} LinkTrainingState;
+
+#endif //DATA_LINK
@@ -0,0 +1,87 @@
+#pragma once
+#ifdef DATA_LINK
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Frames.h"
+
+#ifndef REASSEMBLY_MAX_BYTES
+#define REASSEMBLY_MAX_BYTES (32 * 1024) //budget of all partially received generic frames (reassembly buffers and bitmaps). Can be set with a compile definition
+#endif
+#define REASSEMBLY_TIMEOUT_MS 5000 //a partial frame is dropped after this long without a new fragment (longer than `GENERIC_FRAME_MAX_RTO_MS`, so a backed off sender is not cut off)
+#define REASSEMBLY_SWEEP_PERIOD_MS 1000 //how often expired partial frames are looked for
+#define REASSEMBLY_MUTEX_WAIT_MS 100
+#define REASSEMBLY_COMPLETED_HISTORY 16 //frames completed last, whose resent fragments are ack'd again instead of starting a new frame
+
+#define FRAGMENT_BITMAP_WORD_BITS 32
+
+/**
+ * @brief A generic frame being reassembled. Every fragment but the last carries `FrameSizing::max_generic_data_len`
+ * bytes, so each payload is written straight at its offset in `data`, which is handed off as is once complete
+ *
+ */
+typedef struct _fragment_metadata {
+    std::unique_ptr<std::vector<uint8_t>> data; //reassembled data, sized for `total_frags` full fragments until complete
+    std::vector<uint32_t> received; //bitmap of the fragments stored (bit n - 1 for fragment n)
+    FrameHeader header; //header of the first fragment stored
+    uint16_t total_frags;
+    uint16_t num_fragments_rx;
+    size_t data_len; //length of the reassembled data, known once the last fragment is stored
+    size_t budget_bytes; //bytes charged to `REASSEMBLY_MAX_BYTES` for this frame
+    int64_t last_rx_us; //when the last fragment of this frame arrived (`esp_timer_get_time`)
+} FragmentMetadata;
+
+/**
+ * @brief A frame completed recently (see `REASSEMBLY_COMPLETED_HISTORY`)
+ *
+ */
+typedef struct _completed_frame {
+    uint32_t key; //`get_reassembly_key`
+    uint16_t total_frags; //0 if the slot is unused
+} CompletedFrame;
+
+/**
+ * @brief Counters of the reassembly of generic frames (see `DataLinkManager::get_reassembly_stats`)
+ *
+ */
+typedef struct _reassembly_stats {
+    uint32_t completed; //frames fully reassembled
+    uint32_t timed_out; //partial frames dropped after `REASSEMBLY_TIMEOUT_MS` without a new fragment
+    uint32_t evicted; //partial frames dropped to make room for a new frame under `REASSEMBLY_MAX_BYTES`
+    uint32_t rejected; //new frames dropped because they do not fit in `REASSEMBLY_MAX_BYTES` on their own
+    uint32_t reacked; //fragments of a frame already completed, ack'd again (the sender missed the last ACK)
+    size_t bytes_in_use; //bytes charged to the partial frames
+    size_t num_partial; //frames being reassembled
+} ReassemblyStats;
+
+/**
+ * @brief Key of a frame being reassembled: the sequence numbers are assigned by the sender (per destination), so one
+ * frame per sender and sequence number
+ *
+ * @param sender_id
+ * @param seq_num
+ * @return uint32_t
+ */
+static inline uint32_t get_reassembly_key(uint8_t sender_id, uint16_t seq_num){
+    return (static_cast<uint32_t>(sender_id) << 16) | seq_num;
+}
+
+/**
+ * @brief Whether fragment `frag_num` (1 indexed) of `metadata` has been stored
+ *
+ * @param metadata
+ * @param frag_num
+ * @return true
+ * @return false
+ */
+static inline bool is_fragment_received(const FragmentMetadata& metadata, uint16_t frag_num){
+    uint16_t bit = frag_num - 1;
+    return (metadata.received[bit / FRAGMENT_BITMAP_WORD_BITS] >> (bit % FRAGMENT_BITMAP_WORD_BITS)) & 1;
+}
+
+static inline void set_fragment_received(FragmentMetadata& metadata, uint16_t frag_num){
+    uint16_t bit = frag_num - 1;
+    metadata.received[bit / FRAGMENT_BITMAP_WORD_BITS] |= 1UL << (bit % FRAGMENT_BITMAP_WORD_BITS);
+}
+
+#endif //DATA_LINK
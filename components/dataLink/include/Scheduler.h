@@ -1,87 +1,264 @@
 #ifdef DATA_LINK
 #include "Frames.h"
-#include "esp_timer.h"
+#include "ClassQueue.h"
+#include "MpscRing.h"
 #include <cstdint>
 
 #define SCHEDULER_MUTEX_WAIT 10 //max time duration to wait
-#define SCHEDULER_PERIOD_MS 10
-#define RECEIVE_TASK_PERIOD_MS 2
+#define SCHEDULER_TRAINING_POLL_MS 10 //how often a scheduler paused by `train_link` checks if it can resume
+
+#ifndef SCHEDULER_MIN_FRAME_GAP_US
+#define SCHEDULER_MIN_FRAME_GAP_US 500 //min idle time on a channel between two transmissions: the receiver needs `signal_range_max_ns` (200 us) of idle to end a transmission, then re-arms its RX job. Can be set with a compile definition (0 sends as soon as the channel is idle)
+#endif
+#define SCHEDULER_MAX_BURST_FRAMES 8 //max number of frames packed into a single transmission
+#define SCHEDULER_TASK_STACK_SIZE 4096 //frames are serialized straight into the PHY TX slot (see `SchedulerBurst`), nothing frame sized lives on the stack
+#define RECEIVE_TASK_STACK_SIZE 8192 //the received burst is in `rx_buffers` and frames are parsed in place, nothing burst sized lives on the stack
+#define TASK_STOP_WAIT_MS 500 //how long the destructor waits for a task to stop, eg. a receive task finishing its current receive (longer than a blocking physical layer receive)
+#define TASK_STOP_POLL_MS 10
 
 #define GENERIC_FRAME_SLIDING_WINDOW_SIZE 5 //defines the maximum size of the sliding window before resending previously un-ack'd fragments
 #define SLIDING_WINDOW_MUTEX_TIMEOUT_MS 5
-#define GENERIC_FRAME_MOD_TIMEOUT 10 //be scheduled at most 9 + GENERIC_FRAME_MIN_TIMEOUT times before sending another fragment
-#define GENERIC_FRAME_MIN_TIMEOUT 10
 
-#define SEND_ACK_PERIOD_MS 50
+//retransmission timeout (RTO) of a full window, per destination from its measured round trip time (see `RttEstimator`)
+#define GENERIC_FRAME_INITIAL_RTO_MS 100 //until the first RTT sample of a destination
+#define GENERIC_FRAME_MIN_RTO_MS 10
+#define GENERIC_FRAME_MAX_RTO_MS 2000 //cap of the exponential backoff on repeated timeouts
+#define GENERIC_FRAME_MAX_RETRIES 6 //retransmission timeouts in a row (no ACK moved the window) before a frame is dropped (about 5 s with the backoff)
+#define RTT_CLOCK_GRANULARITY_US 1000 //G of RFC 6298 (FreeRTOS tick)
+#define SCHEDULER_TX_RETRY_MS 100 //how long a fragmented frame that could not be sent (eg. no route yet) waits before trying again
+
+#define SEND_ACK_DELAY_MS 2 //an ACK waits this long for more fragments of the same frame (coalesced) or a burst to the same neighbour (piggybacked)
+#define SEND_ACK_IDLE_POLL_MS 1000 //how often an idle ACK thread checks if it should stop and sweeps expired partial frames (see `reassembly_sweep`)
 #define SEND_ACK_MUTEX_WAIT 10
 
 //Metadata representing the frame to be sent but is currently scheduled
 typedef struct _frame_scheduler_metadata {
     FrameHeader header; //header of the frame
     uint16_t generic_frame_data_offset; //For data greater than MAX_GENERIC_DATA_LEN to keep track of fragment positions
-    int64_t enqueue_time_ns; //when the frame has been first enqueued into the priority queue
+    int64_t enqueue_time_ns; //when the frame was last pushed to the scheduler
     std::shared_ptr<std::vector<uint8_t>> data; // the actual data, and length of data
 
     //sliding window
     uint16_t last_ack; //fragment number represnting the last ack'd fragment (from rx) - head
     uint16_t curr_fragment; //fragment number of the current fragment being sent
-    uint32_t timeout;
+    int64_t next_tx_us; //retransmission timer (`esp_timer_get_time`): when the window is full, un-ack'd fragments are resent from then on
 
+    //control frames only (see `DataLinkManager::send`)
+    int64_t deadline_us; //time (`esp_timer_get_time`) after which the frame is dropped instead of sent, 0 for none
+    uint32_t coalesce_key; //a newer frame with the same key replaces this one while it is queued, 0 for none
 } SchedulerMetadata;
 
+/**
+ * @brief Frames packed back to back into a single transmission. Frames are delimited by their `START_OF_FRAME` byte
+ * and data length
+ *
+ * @note `data` is the TX slot of the PHY (`IPhysicalLayer::acquire_tx_slot`), so frames are serialized once, straight
+ * into the buffer that is transmitted. `phys_tx_mutex` of `channel` is held while the slot is open
+ *
+ */
+typedef struct _scheduler_burst {
+    uint8_t* data; //TX slot of `channel` (nullptr until the first frame is written)
+    size_t capacity; //bytes of `data` a burst may use (TX slot size capped by `FrameSizing::max_burst_size`)
+    size_t length; //number of bytes used in `data`
+    uint8_t channel; //channel the burst will be transmitted on
+    uint8_t num_frames; //number of frames in `data`
+} SchedulerBurst;
+
+/**
+ * @brief Transmit state of a generic frame being fragmented. Frames stay in their entry until every fragment is ack'd
+ * (or sent, for `MISC_UDP_GENERIC_TYPE`) instead of going back through the scheduler queue after every fragment
+ *
+ */
+typedef struct _generic_tx_state {
+    SchedulerMetadata frame; //frame being fragmented and its sliding window (`last_ack`, `curr_fragment`, `next_tx_us`)
+    int64_t hold_until_us; //set when a fragment could not be sent (eg. no route yet), skipped by the scheduler until then
+    uint16_t resend_fragment; //next fragment to check while resending after a retransmission timeout, 0 when not resending
+    int64_t sent_us[GENERIC_FRAME_SLIDING_WINDOW_SIZE]; //when fragment n of the window was sent (at (n - 1) % size), 0 once resent (no RTT sample, Karn's algorithm)
+    uint16_t highest_sent; //highest fragment sent so far - fragments below it sent again after the receiver went back are resends too
+    uint8_t retries; //retransmission timeouts since the window last moved (see `GENERIC_FRAME_MAX_RETRIES`)
+    bool in_use;
+} GenericTxState;
+
+#define SCHEDULER_TX_TABLE_SIZE 16 //generic frames being fragmented at once on a channel
+
+/**
+ * @brief Transmit state table of a channel, walked by its scheduler task (see `DataLinkManager::scheduler_walk_tx_table`)
+ *
+ */
+typedef struct _generic_tx_table {
+    GenericTxState entries[SCHEDULER_TX_TABLE_SIZE];
+    uint8_t num_active; //entries in use
+    uint8_t cursor; //entry the next walk starts from (round-robin between frames and destinations)
+    uint8_t control_run; //control frames sent in a row while fragments were due
+    bool fragment_turn; //fragments and the frames of the class queue take turns
+} GenericTxTable;
+
+/**
+ * @brief Counters of the ack'd generic frames sent on a channel (see `DataLinkManager::get_generic_tx_stats`)
+ *
+ */
+typedef struct _generic_tx_stats {
+    uint32_t completed; //frames with every fragment ack'd
+    uint32_t failed; //frames dropped after `GENERIC_FRAME_MAX_RETRIES` retransmission timeouts in a row
+} GenericTxStats;
+
 typedef struct _frame_ack_record {
     uint16_t last_ack; //last ack'd fragment recevied from the rx
     uint16_t total_frags; //total number of fragments associated with the sequence number
     uint16_t seq_num; //sequence number this ack corresponds to
+    uint32_t sack; //selective ACK: bit i set if fragment `last_ack + 2 + i` was received (`last_ack + 1` is missing)
+    int64_t ack_us; //when the ACK that moved `last_ack` arrived (`esp_timer_get_time`)
 } FrameAckRecord;
 
+/**
+ * @brief Whether `fragment` (past `record.last_ack`) was reported received by the SACK bitmap of `record`
+ *
+ * @param record
+ * @param fragment
+ * @return bool
+ */
+static inline bool is_fragment_sacked(const FrameAckRecord& record, uint16_t fragment){
+    if (fragment < record.last_ack + 2 || fragment - record.last_ack - 2 >= GENERIC_FRAG_ACK_SACK_BITS){
+        return false;
+    }
+    return (record.sack >> (fragment - record.last_ack - 2)) & 1;
+}
+
+/**
+ * @brief Round trip time estimator of a destination (RFC 6298). Drives the retransmission timeout of the generic
+ * frames sent to it
+ *
+ */
+typedef struct _rtt_estimator {
+    int64_t srtt_us; //smoothed round trip time, 0 until the first sample
+    int64_t rttvar_us; //round trip time variation
+    int64_t rto_us; //retransmission timeout
+} RttEstimator;
+
+static inline void rtt_clamp_rto(RttEstimator* rtt){
+    if (rtt->rto_us < GENERIC_FRAME_MIN_RTO_MS * 1000){
+        rtt->rto_us = GENERIC_FRAME_MIN_RTO_MS * 1000;
+    } else if (rtt->rto_us > GENERIC_FRAME_MAX_RTO_MS * 1000){
+        rtt->rto_us = GENERIC_FRAME_MAX_RTO_MS * 1000;
+    }
+}
+
+/**
+ * @brief Resets `rtt` to no sample, with the initial retransmission timeout
+ *
+ * @param rtt
+ */
+static inline void rtt_init(RttEstimator* rtt){
+    rtt->srtt_us = 0;
+    rtt->rttvar_us = 0;
+    rtt->rto_us = GENERIC_FRAME_INITIAL_RTO_MS * 1000;
+}
+
+/**
+ * @brief Updates `rtt` with a measured round trip time and recomputes the retransmission timeout (clears any backoff)
+ *
+ * @param rtt
+ * @param sample_us Time from sending a fragment (sent once) to the ACK that ack'd it
+ */
+static inline void rtt_add_sample(RttEstimator* rtt, int64_t sample_us){
+    if (sample_us <= 0){
+        sample_us = 1;
+    }
+
+    if (rtt->srtt_us == 0){
+        rtt->srtt_us = sample_us;
+        rtt->rttvar_us = sample_us / 2;
+    } else {
+        int64_t err = rtt->srtt_us > sample_us ? rtt->srtt_us - sample_us : sample_us - rtt->srtt_us;
+        rtt->rttvar_us = (3 * rtt->rttvar_us + err) / 4; //beta = 1/4
+        rtt->srtt_us = (7 * rtt->srtt_us + sample_us) / 8; //alpha = 1/8
+    }
+
+    int64_t var_us = 4 * rtt->rttvar_us;
+    rtt->rto_us = rtt->srtt_us + (var_us > RTT_CLOCK_GRANULARITY_US ? var_us : RTT_CLOCK_GRANULARITY_US);
+    rtt_clamp_rto(rtt);
+}
+
+/**
+ * @brief Doubles the retransmission timeout of `rtt` after a timeout, until the next sample
+ *
+ * @param rtt
+ */
+static inline void rtt_backoff(RttEstimator* rtt){
+    rtt->rto_us *= 2;
+    rtt_clamp_rto(rtt);
+}
+
 typedef struct _send_ack_metadata{
     uint8_t data[GENERIC_FRAG_ACK_DATA_SIZE];
     uint8_t sender_id;
 } SendAckMetaData;
 
-typedef struct _frame_compare {
-    /**
-     * @brief Uses aging based priority scheduling (linearly increasing priority with time)
-     *
-     * $P_f = B_f - A_f\alpha$
-     *
-     * - $P_f$ is the effective priority value (lower comes first)
-     *
-     * - $B_f$ is the base priority
-     *
-     * - $A_f$ is the age (amount of time the frame has waited in the queue)
-     *
-     * - $\alpha$ is the aging factor (rate at which a frame increases priority)
-     *
-     * @param a
-     * @param b
-     * @return true
-     * @return false
-     */
-    bool operator()(const SchedulerMetadata& a, const SchedulerMetadata& b) const {
-        int64_t now = esp_timer_get_time();
-        double age_a = (now - a.enqueue_time_ns) / 1e6;
-        double age_b = (now - a.enqueue_time_ns) / 1e6;
-
-        // Base priorities: lower is higher priority
-        double base_a = (IS_CONTROL_FRAME(a.header.type_flag)) ? 0.0 : 10.0;
-        double base_b = (IS_CONTROL_FRAME(b.header.type_flag)) ? 0.0 : 10.0;
-
-        // Aging coefficient (tune this)
-        constexpr double aging_factor = 0.1;
-
-        double effective_a = base_a - age_a * aging_factor;
-        double effective_b = base_b - age_b * aging_factor;
-
-        // If effective priority equal, fall back to enqueue time (FIFO)
-        if (effective_a == effective_b) {
-            return a.enqueue_time_ns > b.enqueue_time_ns;
-        }
-
-        // Return true if a has *lower* priority (so b stays on top)
-        return effective_a < effective_b;
+/**
+ * @brief Key of an ACK waiting in `pending_acks`: one per frame (sender and sequence number)
+ *
+ * @param sender_id
+ * @param seq_num
+ * @return uint32_t
+ */
+static inline uint32_t get_pending_ack_key(uint8_t sender_id, uint16_t seq_num){
+    return (static_cast<uint32_t>(sender_id) << 16) | seq_num;
+}
+
+/**
+ * @brief Traffic classes of the scheduler, each with its own FIFO (see `ClassQueue`)
+ *
+ * CONTROL frames (eg. `MOTOR_TYPE`) are served first, earliest deadline first, at most `SCHEDULER_MAX_CONTROL_RUN`
+ * in a row while other classes wait. RIP, ACK and GENERIC share the rest with deficit round-robin, weighted by their quantum (bytes)
+ */
+enum class SchedulerClass : uint8_t {
+    CONTROL = 0,
+    RIP = 1,
+    ACK = 2,
+    GENERIC = 3,
+};
+
+#define SCHEDULER_NUM_CLASSES 4
+#define SCHEDULER_NUM_STRICT_CLASSES 1 //CONTROL
+#define SCHEDULER_MAX_CONTROL_RUN 8 //control frames sent in a row before a waiting RIP/ACK/GENERIC frame gets a turn
+
+#define SCHEDULER_CONTROL_QUEUE_SIZE 16
+#define SCHEDULER_RIP_QUEUE_SIZE 8
+#define SCHEDULER_ACK_QUEUE_SIZE 16
+#define SCHEDULER_GENERIC_QUEUE_SIZE 16 //single frame generic frames (fragmented ones go to `GenericTxTable`)
+
+#define SCHEDULER_RIP_QUANTUM MAX_FRAME_SIZE //DRR quanta (bytes per round) - at least `MAX_FRAME_SIZE` so every turn sends a frame
+#define SCHEDULER_ACK_QUANTUM (2 * MAX_FRAME_SIZE)
+#define SCHEDULER_GENERIC_QUANTUM (2 * MAX_FRAME_SIZE)
+
+/**
+ * @brief Class a frame is scheduled in
+ *
+ * @param header
+ * @return SchedulerClass
+ */
+static inline SchedulerClass get_scheduler_class(const FrameHeader& header){
+    FrameType type = static_cast<FrameType>(GET_TYPE(header.type_flag));
+    if (type == FrameType::RIP_TABLE_CONTROL){
+        return SchedulerClass::RIP;
+    }
+    if (type == FrameType::ACK_TYPE){
+        return SchedulerClass::ACK;
     }
-} FrameCompare;
+    return IS_CONTROL_FRAME(header.type_flag) ? SchedulerClass::CONTROL : SchedulerClass::GENERIC;
+}
+
+#define SCHEDULER_TX_RING_SIZE 32 //frames pushed to a channel and not yet taken by its scheduler (power of two)
+
+using SchedulerQueue = ClassQueue<SchedulerMetadata, SCHEDULER_NUM_CLASSES>;
+using SchedulerTxRing = MpscRing<SchedulerMetadata, SCHEDULER_TX_RING_SIZE>;
+
+static const SchedulerQueue::Config scheduler_queue_config = {
+    .capacity = {SCHEDULER_CONTROL_QUEUE_SIZE, SCHEDULER_RIP_QUEUE_SIZE, SCHEDULER_ACK_QUEUE_SIZE, SCHEDULER_GENERIC_QUEUE_SIZE},
+    .quantum = {0, SCHEDULER_RIP_QUANTUM, SCHEDULER_ACK_QUANTUM, SCHEDULER_GENERIC_QUANTUM},
+    .edf = {true, false, false, false},
+    .num_strict = SCHEDULER_NUM_STRICT_CLASSES,
+    .max_strict_run = SCHEDULER_MAX_CONTROL_RUN,
+};
 
 #endif //DATA_LINK
@@ -1,12 +1,13 @@
 #pragma once
 #ifdef DATA_LINK
+#include <cstdint>
 #include "freertos/FreeRTOS.h"
+#include "Frames.h"
 
 #define RIP_MAX_HOPS 15 //16 or more is infinite
-#define RIP_MAX_ROUTES 10 //for the demo we will use up to 10 boards in total (9 other boards will be connected = 9 rows)
+#define RIP_MAX_ROUTES 254 //one row per board id (1 - 254, `PC_ADDR` and `BROADCAST_ADDR` are not boards)
 #define RIP_INVALID_ROW 0
 #define RIP_VALID_ROW 1
-#define RIP_NEW_ROW 2
 #define RIP_BROADCAST_INTERVAL 30000 //broadcast every 30 seconds (30000ms)
 // #define RIP_BROADCAST_INTERVAL 3000 //temp broadcast every 3 seconds (3000ms)
 #define RIP_TTL_START 180 //seconds
@@ -30,8 +31,6 @@ typedef struct _rip_row{
     uint8_t ttl; //how long this entry is valid for. starting value is 180 seconds
     uint8_t valid; //is this a valid entry?
     uint8_t ttl_flush; //if hops is invalid, this would count the amount of time until this entry would be invalid (max is in multiples of 30 seconds) but can vary
-    StaticSemaphore_t mutex_buf; //where mutex state is stored
-    SemaphoreHandle_t row_sem; //mutex sem handle of mutex_buf
 } RIPRow;
 
 /**
@@ -49,4 +48,51 @@ typedef struct _rip_public_matrix{
     uint8_t board_id; //Board ID's routing table
 } RIPRow_public_matrix;
 
+/**
+ * @brief Whether `board_id` has a row in the RIP table
+ *
+ * @param board_id
+ * @return true
+ * @return false
+ */
+static inline bool rip_is_board_id(uint8_t board_id){
+    return board_id != PC_ADDR && board_id != BROADCAST_ADDR;
+}
+
+/**
+ * @brief Row of `board_id` in the RIP table (call with a valid board id, see `rip_is_board_id`)
+ *
+ * @param board_id
+ * @return size_t
+ */
+static inline size_t rip_row_index(uint8_t board_id){
+    return board_id - 1;
+}
+
+/**
+ * @brief Packs a row into a single word, so it is read and written with one atomic access: hops (bits 0 - 7),
+ * channel (8 - 15), ttl (16 - 23), valid (24 - 25) and ttl_flush (26 - 31). The board id is the row index
+ *
+ * @param row
+ * @return uint32_t
+ */
+static inline uint32_t rip_pack_row(const RIPRow& row){
+    return static_cast<uint32_t>(row.info.hops) | (static_cast<uint32_t>(row.channel) << 8) |
+        (static_cast<uint32_t>(row.ttl) << 16) | (static_cast<uint32_t>(row.valid & 0x3) << 24) |
+        (static_cast<uint32_t>(row.ttl_flush & 0x3F) << 26);
+}
+
+static inline RIPRow rip_unpack_row(uint8_t board_id, uint32_t packed){
+    return {
+        .info = {
+            .board_id = board_id,
+            .hops = static_cast<uint8_t>(packed & 0xFF),
+        },
+        .channel = static_cast<uint8_t>((packed >> 8) & 0xFF),
+        .ttl = static_cast<uint8_t>((packed >> 16) & 0xFF),
+        .valid = static_cast<uint8_t>((packed >> 24) & 0x3),
+        .ttl_flush = static_cast<uint8_t>((packed >> 26) & 0x3F),
+    };
+}
+
 #endif //DATA_LINK
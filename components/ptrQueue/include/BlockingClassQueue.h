@@ -0,0 +1,56 @@
+#ifndef BLOCKINGCLASSQUEUE_H
+#define BLOCKINGCLASSQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+
+#include "ClassQueue.h"
+
+// `ClassQueue` behind a mutex, with blocking enqueue and dequeue for when several threads share it.
+template <typename T, size_t NumClasses> class BlockingClassQueue {
+  public:
+    using Config = typename ClassQueue<T, NumClasses>::Config;
+
+    explicit BlockingClassQueue(const Config &config) : m_queue(config) {
+    }
+
+    // Enqueue onto the FIFO of `cls` with timeout. Returns true on success, false on timeout (or an invalid class).
+    bool enqueue(T &&item, size_t cls, uint32_t cost, std::chrono::milliseconds max_wait,
+                 int64_t deadline = INT64_MAX, uint32_t key = 0) {
+        std::unique_lock lock(m_mutex);
+        if (!m_cond_not_full.wait_for(lock, max_wait, [this, cls, key]() { return m_queue.can_push(cls, key); })) {
+            return false;
+        }
+
+        m_queue.push(std::move(item), cls, cost, deadline, key);
+        m_cond_not_empty.notify_one();
+        return true;
+    }
+
+    // Dequeue the next item by class policy with timeout. Returns optional<T> (empty on timeout).
+    std::optional<T> dequeue(std::chrono::milliseconds max_wait) {
+        std::unique_lock lock(m_mutex);
+        if (!m_cond_not_empty.wait_for(lock, max_wait, [this]() { return m_queue.size() > 0; })) {
+            return std::nullopt;
+        }
+
+        std::optional<T> item = m_queue.pop();
+        m_cond_not_full.notify_all(); // waiters may be on different classes
+        return item;
+    }
+
+    size_t size(size_t cls) {
+        std::unique_lock lock(m_mutex);
+        return m_queue.size(cls);
+    }
+
+  private:
+    ClassQueue<T, NumClasses> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_cond_not_empty;
+    std::condition_variable m_cond_not_full;
+};
+
+#endif // BLOCKINGCLASSQUEUE_H
@@ -0,0 +1,226 @@
+#ifndef CLASSQUEUE_H
+#define CLASSQUEUE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// Queue made of one fixed size FIFO per class. Enqueue and dequeue are O(1) (independent of the number of
+// items queued) and never compare items.
+//
+// The first `num_strict` classes are served in strict priority (class 0 first). The other classes share what is left
+// with deficit round-robin (DRR): each visit adds `quantum` to the deficit of a class, which is then served while the
+// cost of its head fits. After `max_strict_run` strict dequeues in a row, one waiting DRR class is served so strict
+// traffic cannot starve it (0 disables the bound).
+//
+// Classes with `edf` set are kept sorted by deadline (earliest first, FIFO among equal deadlines) instead of arrival.
+// An item enqueued with a non zero `key` replaces the queued item of the same class with the same key (coalescing),
+// even when the class is full. Both are O(capacity), so only meant for small classes.
+//
+// Not thread safe: meant to be owned by a single consumer (see `BlockingClassQueue` for a locked version).
+template <typename T, size_t NumClasses> class ClassQueue {
+  public:
+    struct Config {
+        std::array<size_t, NumClasses> capacity; // FIFO size of each class
+        std::array<uint32_t, NumClasses> quantum; // DRR credit per visit (>= the largest cost so every visit serves an item)
+        std::array<bool, NumClasses> edf; // serve the class by earliest deadline rather than FIFO
+        size_t num_strict;
+        uint32_t max_strict_run;
+    };
+
+    explicit ClassQueue(const Config &config) : m_config(config) {
+        for (size_t c = 0; c < NumClasses; c++) {
+            m_rings[c].items = std::make_unique<T[]>(config.capacity[c]);
+            m_rings[c].costs = std::make_unique<uint32_t[]>(config.capacity[c]);
+            m_rings[c].deadlines = std::make_unique<int64_t[]>(config.capacity[c]);
+            m_rings[c].keys = std::make_unique<uint32_t[]>(config.capacity[c]);
+        }
+        m_drr_current = m_config.num_strict;
+    }
+
+    // Pushes onto the FIFO of `cls`. Returns false (leaving `item` untouched) if the class is full or invalid.
+    // `deadline` orders `edf` classes (lower first). A non zero `key` replaces the queued item with the same key.
+    bool push(T &&item, size_t cls, uint32_t cost, int64_t deadline = INT64_MAX, uint32_t key = 0) {
+        if (cls >= NumClasses) {
+            return false;
+        }
+
+        Ring &ring = m_rings[cls];
+        size_t capacity = m_config.capacity[cls];
+
+        if (key != 0) {
+            for (size_t i = 0; i < ring.count; i++) {
+                if (ring.keys[(ring.head + i) % capacity] == key) {
+                    remove_at(ring, capacity, i); // superseded, the new item takes its place below
+                    m_size--;
+                    break;
+                }
+            }
+        }
+
+        if (ring.count >= capacity) {
+            return false;
+        }
+
+        // position of the new item: the tail, or behind the last item due no later than it for `edf` classes
+        size_t pos = ring.count;
+        if (m_config.edf[cls]) {
+            while (pos > 0 && ring.deadlines[(ring.head + pos - 1) % capacity] > deadline) {
+                size_t to = (ring.head + pos) % capacity;
+                size_t from = (ring.head + pos - 1) % capacity;
+                move_slot(ring, from, to);
+                pos--;
+            }
+        }
+
+        size_t slot = (ring.head + pos) % capacity;
+        ring.items[slot] = std::move(item);
+        ring.costs[slot] = cost;
+        ring.deadlines[slot] = deadline;
+        ring.keys[slot] = key;
+        ring.count++;
+        m_size++;
+        return true;
+    }
+
+    // Whether `push` onto `cls` with `key` would succeed
+    bool can_push(size_t cls, uint32_t key = 0) const {
+        if (cls >= NumClasses) {
+            return false;
+        }
+
+        const Ring &ring = m_rings[cls];
+        if (ring.count < m_config.capacity[cls]) {
+            return true;
+        }
+        for (size_t i = 0; key != 0 && i < ring.count; i++) {
+            if (ring.keys[(ring.head + i) % m_config.capacity[cls]] == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Pops the next item by class policy. Returns optional<T> (empty if nothing is queued).
+    std::optional<T> pop() {
+        if (m_size == 0) {
+            return std::nullopt;
+        }
+
+        size_t cls = pick_class();
+        Ring &ring = m_rings[cls];
+        T item = std::move(ring.items[ring.head]);
+        ring.head = (ring.head + 1) % m_config.capacity[cls];
+        ring.count--;
+        m_size--;
+        return item;
+    }
+
+    size_t size(size_t cls) const {
+        return cls < NumClasses ? m_rings[cls].count : 0;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+  private:
+    struct Ring {
+        std::unique_ptr<T[]> items;
+        std::unique_ptr<uint32_t[]> costs;
+        std::unique_ptr<int64_t[]> deadlines;
+        std::unique_ptr<uint32_t[]> keys;
+        size_t head = 0;
+        size_t count = 0;
+        uint32_t deficit = 0;
+    };
+
+    void move_slot(Ring &ring, size_t from, size_t to) {
+        ring.items[to] = std::move(ring.items[from]);
+        ring.costs[to] = ring.costs[from];
+        ring.deadlines[to] = ring.deadlines[from];
+        ring.keys[to] = ring.keys[from];
+    }
+
+    // Removes the `index`th item of `ring` (0 is the head), shifting the ones behind it forward
+    void remove_at(Ring &ring, size_t capacity, size_t index) {
+        for (size_t i = index; i + 1 < ring.count; i++) {
+            move_slot(ring, (ring.head + i + 1) % capacity, (ring.head + i) % capacity);
+        }
+        ring.items[(ring.head + ring.count - 1) % capacity] = T{};
+        ring.count--;
+    }
+
+    // Class of the next item. Only called with at least one item queued
+    size_t pick_class() {
+        bool drr_waiting = false;
+        for (size_t c = m_config.num_strict; c < NumClasses; c++) {
+            drr_waiting |= m_rings[c].count > 0;
+        }
+
+        for (size_t c = 0; c < m_config.num_strict; c++) {
+            if (m_rings[c].count == 0) {
+                continue;
+            }
+            if (drr_waiting && m_config.max_strict_run != 0 && m_strict_run >= m_config.max_strict_run) {
+                break; // let one DRR item through
+            }
+            m_strict_run++;
+            return c;
+        }
+
+        m_strict_run = 0;
+        return pick_drr_class();
+    }
+
+    size_t pick_drr_class() {
+        if (m_config.num_strict >= NumClasses) {
+            return 0;
+        }
+
+        // a class is visited at most twice before one is served (once the quantum covers the largest cost)
+        for (size_t step = 0; step <= 2 * NumClasses; step++) {
+            Ring &ring = m_rings[m_drr_current];
+            if (ring.count == 0) {
+                ring.deficit = 0; // an idle class does not bank credit
+                next_drr_class();
+                continue;
+            }
+
+            if (!m_drr_visit_started) {
+                ring.deficit += m_config.quantum[m_drr_current];
+                m_drr_visit_started = true;
+            }
+
+            uint32_t cost = ring.costs[ring.head];
+            if (cost <= ring.deficit) {
+                ring.deficit -= cost;
+                return m_drr_current;
+            }
+            next_drr_class();
+        }
+
+        // quantum smaller than the cost - serve the first waiting class rather than spin
+        for (size_t c = m_config.num_strict; c < NumClasses; c++) {
+            if (m_rings[c].count > 0) {
+                return c;
+            }
+        }
+        return 0;
+    }
+
+    void next_drr_class() {
+        m_drr_current = m_drr_current + 1 < NumClasses ? m_drr_current + 1 : m_config.num_strict;
+        m_drr_visit_started = false;
+    }
+
+    Config m_config;
+    std::array<Ring, NumClasses> m_rings;
+    size_t m_size = 0;
+    size_t m_drr_current = 0; // DRR class being visited
+    bool m_drr_visit_started = false; // whether the current class already got its quantum this visit
+    uint32_t m_strict_run = 0; // strict dequeues in a row
+};
+
+#endif // CLASSQUEUE_H
@@ -0,0 +1,74 @@
+#ifndef MPSCRING_H
+#define MPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Lock-free bounded ring for many producers and a single consumer. Never blocks: `try_push` fails when the ring is
+// full and `front` returns nullptr when it is empty, the caller decides how to wait.
+//
+// Each slot carries a sequence number (Vyukov's bounded queue): a producer claims the tail with a CAS and publishes
+// the slot by bumping its sequence, so the consumer only ever sees fully written items. `Capacity` must be a power of
+// two.
+template <typename T, size_t Capacity> class MpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "MpscRing capacity must be a power of two");
+
+  public:
+    MpscRing() : m_slots(std::make_unique<Slot[]>(Capacity)) {
+        for (size_t i = 0; i < Capacity; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Pushes from any thread. Returns false (leaving `item` untouched) if the ring is full.
+    bool try_push(T &item) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = m_slots[pos & (Capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.item = std::move(item);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // the consumer has not freed this slot yet
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed); // another producer took it
+            }
+        }
+    }
+
+    // Oldest item, or nullptr if the ring is empty. Consumer only, valid until `pop`
+    T *front() {
+        Slot &slot = m_slots[m_head & (Capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+            return nullptr;
+        }
+        return &slot.item;
+    }
+
+    // Frees the slot returned by `front`. Consumer only
+    void pop() {
+        Slot &slot = m_slots[m_head & (Capacity - 1)];
+        slot.item = T{};
+        slot.sequence.store(m_head + Capacity, std::memory_order_release);
+        m_head++;
+    }
+
+  private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_tail{0}; // next slot producers claim
+    alignas(64) size_t m_head = 0; // next slot the consumer reads
+};
+
+#endif // MPSCRING_H
@@ -0,0 +1,453 @@
+#include "RMTCodec.h"
+#include "RMTSymbols.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+
+/**
+ * @brief Byte -> Manchester symbols lookup table. Kept in internal RAM as it is read from the RMT ISR
+ *
+ */
+DRAM_ATTR constinit static const rmt_manchester_table_t manchester_table = make_manchester_table();
+
+/**
+ * @brief Byte -> 4B/5B + NRZI symbols lookup table. Kept in internal RAM as it is read from the RMT ISR
+ *
+ */
+DRAM_ATTR constinit static const rmt_nrzi_table_t nrzi_table = make_4b5b_nrzi_table();
+
+static constexpr rmt_4b5b_decode_table_t decode_4b5b_table = make_4b5b_decode_table();
+
+/**
+ * @brief This is a callback function called by RMT when transmitting. It encodes the user data `data` with the line
+ * code of the channel (`ctx->line_code`): `encode_manchester` or `encode_4b5b_nrzi`
+ *
+ * @param data
+ * @param data_size
+ * @param symbols_written
+ * @param symbols_free
+ * @param symbols
+ * @param done
+ * @param arg
+ */
+size_t RMTCodec::encoder_callback(const void* data, size_t data_size, size_t symbols_written, 
+            size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg){      
+
+    rmt_encoder_context_t* ctx = (rmt_encoder_context_t*) arg; //get the current context
+    if (symbols_written == 0){
+        reset_encoder_context(ctx); //start of a new transmission
+    }
+
+    const uint8_t* bytes = (const uint8_t*)data; //get the user data as an array of bytes
+    size_t symbols_used = 0;
+
+    switch (ctx->line_code){
+        case LineCode::NRZI_4B5B:
+            symbols_used = encode_4b5b_nrzi(bytes, data_size, ctx, symbols, symbols_free);
+            *done = ctx->end_sent;
+            break;
+        case LineCode::MANCHESTER:
+        default:
+            symbols_used = encode_manchester(bytes, data_size, ctx, symbols, symbols_free);
+            *done = (ctx->byte_index >= data_size); //if the transmit is done, set the `done` flag to true (all bytes have been encoded)
+            break;
+    }
+
+    ctx->num_symbols += symbols_used;
+    return symbols_used;
+}
+
+/**
+ * @brief Manchester encoder. A bit 1 is transmitted as a `RMT_SYMBOL_ONE` and a bit 0 is transmitted as a `RMT_SYMBOL_ZERO`
+ * (see `RMTSymbols.h`)
+ *
+ * Whole bytes are taken from `manchester_table` (8 symbols at a time) with the symbol duration of the channel OR'd in.
+ * If `symbols_free` runs out in the middle of a byte, the remaining bits of that byte are encoded on the next call
+ * (tracked by `bit_index` in the context)
+ *
+ * @return size_t number of symbols written
+ */
+size_t RMTCodec::encode_manchester(const uint8_t* bytes, size_t data_size, rmt_encoder_context_t* ctx, rmt_symbol_word_t* symbols, size_t symbols_free){
+    size_t symbols_used = 0; //number of symbols used
+
+    const uint32_t durations = ctx->symbol_durations;
+
+    //finish the byte that was cut off by the previous call (if any)
+    while (ctx->bit_index != 0 && ctx->byte_index < data_size && symbols_used < symbols_free){
+        symbols[symbols_used++].val = manchester_table.symbols[bytes[ctx->byte_index]][ctx->bit_index++].val | durations;
+        if (ctx->bit_index >= RMT_BITS_PER_BYTE){
+            ctx->bit_index = 0;
+            ctx->byte_index++;
+        }
+    }
+
+    //encode whole bytes while there is room for all 8 symbols
+    while (ctx->byte_index < data_size && symbols_free - symbols_used >= RMT_BITS_PER_BYTE){
+        const rmt_symbol_word_t* byte_symbols = manchester_table.symbols[bytes[ctx->byte_index]];
+        for (uint8_t i = 0; i < RMT_BITS_PER_BYTE; i++){
+            symbols[symbols_used + i].val = byte_symbols[i].val | durations;
+        }
+        symbols_used += RMT_BITS_PER_BYTE;
+        ctx->byte_index++;
+    }
+
+    //start the next byte with whatever room is left (resumed on the next call)
+    while (ctx->byte_index < data_size && symbols_used < symbols_free){
+        symbols[symbols_used++].val = manchester_table.symbols[bytes[ctx->byte_index]][ctx->bit_index++].val | durations;
+    }
+
+    return symbols_used;
+}
+
+/**
+ * @brief 4B/5B + NRZI encoder. Every code bit is one pulse of the symbol duration (a 1 flips the line), so a byte takes
+ * 5 symbols from `nrzi_table`, with the levels flipped while the line is high (`level_mask`).
+ *
+ * The bytes are framed by delimiters so the receiver can count code bits from the first edge to the last one:
+ * `RMT_NRZI_DELIMITER_FROM_LOW` before the first byte, then `RMT_NRZI_DELIMITER_FROM_LOW`/`RMT_NRZI_DELIMITER_FROM_HIGH`
+ * after the last byte so the line always ends low on a transition. A byte cut off by `symbols_free` is resumed on the
+ * next call (tracked by `bit_index`, in symbols)
+ *
+ * @return size_t number of symbols written
+ */
+size_t RMTCodec::encode_4b5b_nrzi(const uint8_t* bytes, size_t data_size, rmt_encoder_context_t* ctx, rmt_symbol_word_t* symbols, size_t symbols_free){
+    size_t symbols_used = 0;
+
+    const uint32_t durations = ctx->symbol_durations;
+
+    if (!ctx->start_sent && symbols_used < symbols_free){
+        symbols[symbols_used++].val = RMT_NRZI_DELIMITER_FROM_LOW.val | durations;
+        ctx->start_sent = true;
+        ctx->level_mask = 0;
+    }
+
+    while (ctx->start_sent && ctx->byte_index < data_size && symbols_used < symbols_free){
+        const uint8_t byte = bytes[ctx->byte_index];
+        const rmt_symbol_word_t* byte_symbols = nrzi_table.symbols[byte];
+
+        if (ctx->bit_index == 0 && symbols_free - symbols_used >= RMT_NRZI_SYMBOLS_PER_BYTE){
+            for (uint8_t i = 0; i < RMT_NRZI_SYMBOLS_PER_BYTE; i++){
+                symbols[symbols_used + i].val = (byte_symbols[i].val ^ ctx->level_mask) | durations;
+            }
+            symbols_used += RMT_NRZI_SYMBOLS_PER_BYTE;
+        } else {
+            //not enough room for the whole byte (or finishing a byte that was cut off)
+            while (ctx->bit_index < RMT_NRZI_SYMBOLS_PER_BYTE && symbols_used < symbols_free){
+                symbols[symbols_used++].val = (byte_symbols[ctx->bit_index++].val ^ ctx->level_mask) | durations;
+            }
+            if (ctx->bit_index < RMT_NRZI_SYMBOLS_PER_BYTE){
+                break;
+            }
+            ctx->bit_index = 0;
+        }
+
+        if (nrzi_table.ends_high[byte]){
+            ctx->level_mask ^= RMT_SYMBOL_LEVELS_MASK;
+        }
+        ctx->byte_index++;
+    }
+
+    if (ctx->start_sent && ctx->byte_index >= data_size && !ctx->end_sent && symbols_used < symbols_free){
+        const rmt_symbol_word_t end = ctx->level_mask ? RMT_NRZI_DELIMITER_FROM_HIGH : RMT_NRZI_DELIMITER_FROM_LOW;
+        symbols[symbols_used++].val = end.val | durations;
+        ctx->end_sent = true;
+    }
+
+    return symbols_used;
+}
+
+void RMTCodec::reset_encoder_context(rmt_encoder_context_t* ctx){
+    ctx->bit_index = 0;
+    ctx->byte_index = 0;
+    ctx->num_symbols = 0;
+    ctx->level_mask = 0;
+    ctx->start_sent = false;
+    ctx->end_sent = false;
+}
+
+#define RMT_RX_END_OF_FRAME 0
+#define RMT_RX_INVALID_PULSE 0xFF
+
+/**
+ * @brief Returns the number of half bits (1 or 2) a received pulse of length `duration` spans,
+ * `RMT_RX_END_OF_FRAME` for the end marker, or `RMT_RX_INVALID_PULSE` if it is outside of the tolerance windows
+ *
+ * @param duration
+ * @param symbol_duration Half bit duration of the channel
+ * @return uint8_t
+ */
+static inline uint8_t half_bits_in_pulse(uint16_t duration, uint16_t symbol_duration){
+    uint32_t duration_x2 = 2 * (uint32_t)duration;
+    if (duration == 0){
+        return RMT_RX_END_OF_FRAME;
+    }
+    if (duration_x2 < RMT_RX_HALF_BIT_MIN_X2(symbol_duration)){
+        return RMT_RX_INVALID_PULSE; //glitch
+    }
+    if (duration_x2 < RMT_RX_HALF_BIT_MAX_X2(symbol_duration)){
+        return 1;
+    }
+    if (duration_x2 < RMT_RX_FULL_BIT_MAX_X2(symbol_duration)){
+        return 2;
+    }
+    return RMT_RX_INVALID_PULSE;
+}
+
+/**
+ * @brief Decodes the raw received `symbols` of a whole frame straight into bytes with the line code `line_code`
+ * (`decode_manchester` or `decode_4b5b_nrzi`)
+ *
+ * @param symbols received symbols
+ * @param num number of received symbols
+ * @param bytes decoded bytes
+ * @param output_num size of `bytes`
+ * @param symbol_duration shortest pulse (ticks) the symbols were sent with
+ * @param line_code line code the symbols were sent with
+ * @return int - number of bytes written (-1 if failure)
+ */
+int RMTCodec::decode_symbols(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, uint16_t symbol_duration,
+            LineCode line_code){
+    if (symbols == NULL || bytes == NULL || num == 0 || output_num == 0 || symbol_duration == 0){
+        return ESP_FAIL;
+    }
+
+    rmt_decoder_context_t ctx;
+    reset_decoder_context(&ctx);
+    ctx.symbol_duration = symbol_duration;
+    ctx.line_code = line_code;
+
+    decode_chunk(symbols, num, bytes, output_num, &ctx);
+    return finish_decoding(bytes, output_num, &ctx);
+}
+
+/**
+ * @brief Decodes the next `num` received symbols of the frame tracked by `ctx` into `bytes`. The symbols of a frame
+ * can be split into chunks anywhere (eg. as the RMT driver hands them over with partial RX), the result is the same
+ * as decoding them at once. Once the frame is done or failed, the remaining chunks are ignored
+ *
+ * @param symbols received symbols
+ * @param num number of received symbols (may be 0)
+ * @param bytes decoded bytes of the whole frame
+ * @param output_num size of `bytes`
+ * @param ctx decoder state of the frame (see `reset_decoder_context`)
+ */
+void RMTCodec::decode_chunk(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx){
+    if (ctx->done || ctx->failed || symbols == NULL || bytes == NULL || ctx->symbol_duration == 0){
+        return;
+    }
+
+    switch (ctx->line_code){
+        case LineCode::NRZI_4B5B:
+            decode_4b5b_nrzi(symbols, num, bytes, output_num, ctx);
+            break;
+        case LineCode::MANCHESTER:
+        default:
+            decode_manchester(symbols, num, bytes, output_num, ctx);
+            break;
+    }
+}
+
+/**
+ * @brief Completes the frame tracked by `ctx` once its last chunk was decoded
+ *
+ * @param bytes decoded bytes of the whole frame
+ * @param output_num size of `bytes`
+ * @param ctx
+ * @return int - number of bytes written (-1 if failure)
+ */
+int RMTCodec::finish_decoding(uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx){
+    if (ctx->failed || bytes == NULL){
+        return ESP_FAIL;
+    }
+
+    if (ctx->line_code != LineCode::NRZI_4B5B && ctx->first_half == 1 && ctx->bit_count == RMT_BITS_PER_BYTE - 1 && ctx->output_index < output_num){
+        //trailing Manchester 1 (its low half is the idle line)
+        bytes[ctx->output_index++] = (uint8_t)((ctx->bits << 1) | 1);
+        ctx->first_half = -1;
+        ctx->bit_count = 0;
+    }
+    ctx->done = true;
+
+    return (int)ctx->output_index;
+}
+
+void RMTCodec::reset_decoder_context(rmt_decoder_context_t* ctx){
+    ctx->output_index = 0;
+    ctx->bits = 0;
+    ctx->bit_count = 0;
+    ctx->first_half = -1;
+    ctx->started = false;
+    ctx->delimiter_bits = RMT_NRZI_DELIMITER_BITS;
+    ctx->done = false;
+    ctx->failed = false;
+}
+
+/**
+ * @brief Decodes the raw received Manchester `symbols` straight into bytes (single pass, no intermediate symbol buffer)
+ *
+ * Every received pulse is split into half bits (see `half_bits_in_pulse`), and every pair of half bits is one bit:
+ * high then low is a 1 (`RMT_SYMBOL_ONE`), low then high is a 0 (`RMT_SYMBOL_ZERO`).
+ *
+ * Since the line idles low, two half bits cannot be seen:
+ * - if the first bit is a 0, its low half merges with the idle line (the first high pulse is then 2 half bits long).
+ *   Two leading 0 bits cannot be told apart from a leading 1, which is fine as every frame starts with `START_OF_FRAME` (0xAB)
+ * - if the last bit is a 1, its low half merges with the idle line (added back by `finish_decoding`)
+ *
+ * @param symbols received symbols
+ * @param num number of received symbols
+ * @param bytes decoded bytes
+ * @param output_num size of `bytes`
+ * @param ctx decoder state, carried over from the previous chunk of the frame
+ */
+void RMTCodec::decode_manchester(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx){
+    const uint16_t symbol_duration = ctx->symbol_duration;
+    size_t output_index = ctx->output_index;
+    uint8_t byte = (uint8_t)ctx->bits;
+    uint8_t bit_count = ctx->bit_count;
+    int8_t first_half = ctx->first_half;
+
+    for (size_t i = 0; i < num && !ctx->done && output_index < output_num; i++){
+        const uint16_t durations[2] = {symbols[i].duration0, symbols[i].duration1};
+        const uint8_t levels[2] = {(uint8_t)symbols[i].level0, (uint8_t)symbols[i].level1};
+
+        for (uint8_t pulse = 0; pulse < 2 && output_index < output_num; pulse++){
+            uint8_t half_bits = half_bits_in_pulse(durations[pulse], symbol_duration);
+            if (half_bits == RMT_RX_END_OF_FRAME){
+                ctx->done = true;
+                break;
+            }
+            if (half_bits == RMT_RX_INVALID_PULSE){
+                ctx->failed = true;
+                return;
+            }
+
+            if (!ctx->started && half_bits == 2){
+                first_half = 0; //first bit is a 0 - insert its low half
+            }
+            ctx->started = true;
+
+            for (uint8_t h = 0; h < half_bits; h++){
+                if (first_half < 0){
+                    first_half = levels[pulse];
+                    continue;
+                }
+
+                if (first_half == levels[pulse]){
+                    ctx->failed = true; //no transition in the middle of the bit
+                    return;
+                }
+
+                byte = (byte << 1) | first_half; //high -> low is a 1, low -> high is a 0
+                first_half = -1;
+
+                if (++bit_count == RMT_BITS_PER_BYTE){
+                    bytes[output_index++] = byte;
+                    byte = 0;
+                    bit_count = 0;
+                    if (output_index >= output_num){
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (output_index >= output_num){
+        ctx->done = true;
+    }
+    ctx->output_index = output_index;
+    ctx->bits = byte;
+    ctx->bit_count = bit_count;
+    ctx->first_half = first_half;
+}
+
+/**
+ * @brief Returns the number of code bits (1 to `RMT_NRZI_MAX_RUN_BITS`) a received 4B/5B + NRZI pulse of length
+ * `duration` spans, `RMT_RX_END_OF_FRAME` for the end marker, or `RMT_RX_INVALID_PULSE` if it is not within half a
+ * code bit of a whole number of code bits
+ *
+ * @param duration
+ * @param symbol_duration Code bit duration of the channel
+ * @return uint8_t
+ */
+static inline uint8_t code_bits_in_pulse(uint16_t duration, uint16_t symbol_duration){
+    if (duration == 0){
+        return RMT_RX_END_OF_FRAME;
+    }
+    uint32_t code_bits = (2 * (uint32_t)duration + symbol_duration) / (2 * (uint32_t)symbol_duration); //rounded to the nearest code bit
+    if (code_bits == 0 || code_bits > RMT_NRZI_MAX_RUN_BITS){
+        return RMT_RX_INVALID_PULSE;
+    }
+    return (uint8_t)code_bits;
+}
+
+/**
+ * @brief Decodes the raw received 4B/5B + NRZI `symbols` straight into bytes (single pass)
+ *
+ * Every received pulse starts with a transition (a 1 code bit) followed by 0 code bits for the rest of the pulse. The
+ * first `RMT_NRZI_DELIMITER_BITS` code bits are the start delimiter, then every 10 code bits are a byte. The code bits
+ * left over at the end marker (fewer than 10) are the end delimiter. A code that is not a 4B/5B data code fails the
+ * whole receive
+ *
+ * @param symbols received symbols
+ * @param num number of received symbols
+ * @param bytes decoded bytes
+ * @param output_num size of `bytes`
+ * @param ctx decoder state, carried over from the previous chunk of the frame
+ */
+void RMTCodec::decode_4b5b_nrzi(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx){
+    const uint16_t symbol_duration = ctx->symbol_duration;
+    size_t output_index = ctx->output_index;
+    uint16_t code = ctx->bits; //code bits of the byte being decoded (MSB first)
+    uint8_t code_bits = ctx->bit_count;
+    uint8_t delimiter_bits = ctx->delimiter_bits; //start delimiter bits left to skip
+
+    for (size_t i = 0; i < num && !ctx->done && output_index < output_num; i++){
+        const uint16_t durations[2] = {symbols[i].duration0, symbols[i].duration1};
+
+        for (uint8_t pulse = 0; pulse < 2 && output_index < output_num; pulse++){
+            uint8_t run = code_bits_in_pulse(durations[pulse], symbol_duration);
+            if (run == RMT_RX_END_OF_FRAME){
+                ctx->done = true;
+                break;
+            }
+            if (run == RMT_RX_INVALID_PULSE){
+                ctx->failed = true;
+                return;
+            }
+
+            for (uint8_t b = 0; b < run; b++){
+                if (delimiter_bits > 0){
+                    delimiter_bits--;
+                    continue;
+                }
+
+                code = (code << 1) | (b == 0); //the transition at the start of the pulse is the 1
+                if (++code_bits < 2 * RMT_4B5B_CODE_BITS){
+                    continue;
+                }
+
+                uint8_t high = decode_4b5b_table.nibbles[(code >> RMT_4B5B_CODE_BITS) & 0x1F];
+                uint8_t low = decode_4b5b_table.nibbles[code & 0x1F];
+                if (high == RMT_4B5B_INVALID_CODE || low == RMT_4B5B_INVALID_CODE){
+                    ctx->failed = true;
+                    return;
+                }
+
+                bytes[output_index++] = (high << 4) | low;
+                code = 0;
+                code_bits = 0;
+                if (output_index >= output_num){
+                    break;
+                }
+            }
+        }
+    }
+
+    if (output_index >= output_num){
+        ctx->done = true;
+    }
+    ctx->output_index = output_index;
+    ctx->bits = code;
+    ctx->bit_count = code_bits;
+    ctx->delimiter_bits = delimiter_bits;
+}
@@ -1,22 +1,37 @@
 #include "RMTManager.h"
+#include "RMTCodec.h"
 #include "RMTSymbols.h"
 #include "driver/rmt_tx.h"
 #include "driver/rmt_rx.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 /**
  * @brief Construct a new RMTManager::RMTManager object
  * 
  * @param num_channels Number of channels to init (1-4) inclusive
+ * @param config MTU and DMA configuration of the channels (see `RMT_MANAGER_DEFAULT_CONFIG`)
  */
-RMTManager::RMTManager(uint8_t num_channels = MAX_CHANNELS){
+RMTManager::RMTManager(uint8_t num_channels, const rmt_manager_config_t& config) : config(config){
+    this->num_channels = 0;
     if (num_channels > MAX_CHANNELS || num_channels == 0){
         ESP_LOGE(DEBUG_TAG, "Invalid number of channels to init");
         return;
     }
+    if (config.mtu == 0 || config.mtu > RMT_MAX_MTU){
+        ESP_LOGE(DEBUG_TAG, "Invalid MTU %d", config.mtu);
+        return;
+    }
     this->num_channels = num_channels;
+    if (alloc_channels() != ESP_OK){
+        ESP_LOGE(DEBUG_TAG, "Failed to allocate the state of %d channels", num_channels);
+        free_channels();
+        this->num_channels = 0;
+        return;
+    }
     esp_err_t res = init();
     if (res != ESP_OK){
         //failed
@@ -26,21 +41,107 @@ RMTManager::RMTManager(uint8_t num_channels = MAX_CHANNELS){
     ESP_LOGI(DEBUG_TAG, "RMTManager has been initialized");
 }
 
-esp_err_t RMTManager::init_tx_channel(){
-    esp_err_t res_tx = ESP_FAIL;
-    memory_to_free = xQueueCreate(15, sizeof(uint8_t*));
+/**
+ * @brief Allocates the state of the `num_channels` channels. The encoder and TX done callbacks only touch
+ * `rmt_channel_isr_state`, which stays in internal RAM. The rest is only used by tasks and goes to PSRAM when there is some
+ *
+ * @return esp_err_t
+ */
+esp_err_t RMTManager::alloc_channels(){
+    channels = (rmt_channel*)heap_caps_calloc_prefer(num_channels, sizeof(rmt_channel), 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_DEFAULT);
+    if (channels == nullptr){
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < num_channels; i++){
+        channels[i].isr = (rmt_channel_isr_state*)heap_caps_calloc(1, sizeof(rmt_channel_isr_state), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (channels[i].isr == nullptr){
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+void RMTManager::free_channels(){
+    if (channels == nullptr){
+        return;
+    }
+    for (uint8_t i = 0; i < num_channels; i++){
+        heap_caps_free(channels[i].isr);
+    }
+    heap_caps_free(channels);
+    channels = nullptr;
+}
+
+/**
+ * @brief Allocates the TX slots (sized by the MTU), the RX buffer (`RMT_RX_CHUNK_SYMBOLS`) and the decoded frame
+ * buffers (sized by the MTU) of `channel_num`
+ *
+ * @param channel_num
+ * @return esp_err_t
+ */
+esp_err_t RMTManager::alloc_channel_buffers(uint8_t channel_num){
+    //the RX DMA (or the RX ISR without DMA) writes into the RX buffer, the RX done callback writes the decoded frames and
+    //the encoder callback reads the TX slots, so all of them stay in internal RAM
+    const uint32_t rx_caps = config.with_dma ? (MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL) : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    for (uint8_t i = 0; i < TX_QUEUE_DEPTH; i++){
+        if (channels[channel_num].isr->tx_slots.slots[i].data == nullptr){
+            channels[channel_num].isr->tx_slots.slots[i].data = (uint8_t*)heap_caps_malloc(config.mtu, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (channels[channel_num].isr->tx_slots.slots[i].data == nullptr){
+            return ESP_ERR_NO_MEM;
+        }
+    }
 
-    xTaskCreate(RMTManager::freeMemory, "RIPFreeMem", 4096, static_cast<void*>(memory_to_free), 5, NULL);
-    memory_to_free = xQueueCreate(15, sizeof(uint8_t*));
+    if (channels[channel_num].raw_symbols == nullptr){
+        channels[channel_num].raw_symbols = (rmt_symbol_word_t*)heap_caps_malloc(RMT_RX_CHUNK_SYMBOLS * sizeof(rmt_symbol_word_t), rx_caps);
+    }
+    if (channels[channel_num].raw_symbols == nullptr){
+        return ESP_ERR_NO_MEM;
+    }
+
+    RxCallbackContext* rx_context = &channels[channel_num].isr->rx_context;
+    for (uint8_t i = 0; i < 2; i++){
+        if (rx_context->frames[i] == nullptr){
+            rx_context->frames[i] = (uint8_t*)heap_caps_malloc(config.mtu, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (rx_context->frames[i] == nullptr){
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    rx_context->mtu = config.mtu;
+
+    return ESP_OK;
+}
 
-    xTaskCreate(RMTManager::freeMemory, "RIPFreeMem", 4096, static_cast<void*>(memory_to_free), 5, NULL);
+void RMTManager::free_channel_buffers(uint8_t channel_num){
+    for (uint8_t i = 0; i < TX_QUEUE_DEPTH; i++){
+        heap_caps_free(channels[channel_num].isr->tx_slots.slots[i].data);
+        channels[channel_num].isr->tx_slots.slots[i].data = nullptr;
+    }
+    heap_caps_free(channels[channel_num].raw_symbols);
+    channels[channel_num].raw_symbols = nullptr;
+    for (uint8_t i = 0; i < 2; i++){
+        heap_caps_free(channels[channel_num].isr->rx_context.frames[i]);
+        channels[channel_num].isr->rx_context.frames[i] = nullptr;
+    }
+}
+
+esp_err_t RMTManager::init_tx_channel(){
+    esp_err_t res_tx = ESP_FAIL;
 
     for (uint8_t i = 0; i < num_channels; i++){
         //setup encoder config
-        reset_encoder_context(&channels[i].encoder_context); //ensure the encoder context is initialized
+        RMTCodec::reset_encoder_context(&channels[i].isr->encoder_context); //ensure the encoder context is initialized
+        channels[i].symbol_duration = RMT_DURATION_SYMBOL;
+        channels[i].isr->encoder_context.symbol_durations = RMT_SYMBOL_DURATIONS(RMT_DURATION_SYMBOL);
+        channels[i].line_code = LineCode::MANCHESTER;
+        channels[i].isr->encoder_context.line_code = LineCode::MANCHESTER;
         rmt_simple_encoder_config_t encoder_config = {
-            .callback = encoder_callback,
-            .arg = &channels[i].encoder_context
+            .callback = RMTCodec::encoder_callback,
+            .arg = &channels[i].isr->encoder_context
         };
         
         //create encoder
@@ -62,11 +163,11 @@ esp_err_t RMTManager::init_tx_channel(){
             .gpio_num = tx_gpio[i],
             .clk_src = RMT_CLK_SRC_DEFAULT,
             .resolution_hz = RMT_RESOLUTION_HZ,
-            .mem_block_symbols = RMT_SYMBOL_BLOCK_SIZE, //giving each channel ~192B of memory
-            .trans_queue_depth = 4,
+            .mem_block_symbols = config.with_dma ? RMT_DMA_SYMBOL_BLOCK_SIZE : RMT_SYMBOL_BLOCK_SIZE,
+            .trans_queue_depth = TX_QUEUE_DEPTH,
             .flags = {
                 .invert_out = 0,
-                .with_dma = 0,
+                .with_dma = config.with_dma,
             }
         }; 
         
@@ -83,9 +184,26 @@ esp_err_t RMTManager::init_tx_channel(){
             channels[i].tx_done_semaphore = NULL;
         }
 
-        channels[i].tx_queue = xQueueCreate(QUEUE_SIZE, sizeof(TxBuffer)); //can store up to 10 queued transmissions (each transmission size being 192B; based ont he RMT_SYMBOL_BLOCK_SIZE)
+        if (channels[i].isr->tx_slots.free_slots == NULL){
+            channels[i].isr->tx_slots.free_slots = xSemaphoreCreateCounting(TX_QUEUE_DEPTH, TX_QUEUE_DEPTH); //every slot starts free
+        }
+        channels[i].isr->tx_slots.head = 0;
+        channels[i].isr->tx_slots.tail = 0;
+        channels[i].isr->tx_slots.acquired = false;
+
+        if (alloc_channel_buffers(i) != ESP_OK){
+            ESP_LOGE(DEBUG_TAG, "Failed to allocate buffers for channel %d", i);
+            continue;
+        }
 
         res_tx = rmt_new_tx_channel(&tx_channel_config_template, &channels[i].tx_rmt_handle);
+        if (res_tx == ESP_ERR_NOT_FOUND && tx_channel_config_template.flags.with_dma){
+            //no DMA capable TX channel left - the encoder callback refills the channel memory instead
+            ESP_LOGW(DEBUG_TAG, "No DMA TX channel left for channel %d, falling back to non-DMA", i);
+            tx_channel_config_template.mem_block_symbols = RMT_SYMBOL_BLOCK_SIZE;
+            tx_channel_config_template.flags.with_dma = 0;
+            res_tx = rmt_new_tx_channel(&tx_channel_config_template, &channels[i].tx_rmt_handle);
+        }
         
         //init tx channel
         if (res_tx != ESP_OK) {
@@ -103,11 +221,10 @@ esp_err_t RMTManager::init_tx_channel(){
         
         channels[i].tx_done_semaphore = xSemaphoreCreateBinary(); //create a binary sem
         
-        channels[i].tx_context = {
+        channels[i].isr->tx_context = {
             .tx_done_sem = channels[i].tx_done_semaphore,
-            .transmit_queue = channels[i].tx_queue,
-            .tx_context = &channels[i].encoder_context,
-            .free_mem_queue = memory_to_free,
+            .slot_ring = &channels[i].isr->tx_slots,
+            .tx_context = &channels[i].isr->encoder_context,
         };
 
         if (channels[i].tx_done_semaphore == NULL){
@@ -116,7 +233,7 @@ esp_err_t RMTManager::init_tx_channel(){
         }
 
         // res_tx = rmt_tx_register_event_callbacks(channels[i].tx_rmt_handle, &tx_cbs, channels[i].tx_done_semaphore);
-        res_tx = rmt_tx_register_event_callbacks(channels[i].tx_rmt_handle, &tx_cbs, static_cast<void*>(&channels[i].tx_context));
+        res_tx = rmt_tx_register_event_callbacks(channels[i].tx_rmt_handle, &tx_cbs, static_cast<void*>(&channels[i].isr->tx_context));
 
         if (res_tx != ESP_OK) {
             // printf("Failed to register TX callback\n");
@@ -147,26 +264,17 @@ bool RMTManager::rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx
     TxCallbackContext* args = static_cast<TxCallbackContext*>(user_data);
 
     SemaphoreHandle_t sem = args->tx_done_sem;
-    QueueHandle_t queue = args->transmit_queue;
+    TxSlotRing* ring = args->slot_ring;
     rmt_encoder_context_t* encoder_context = args->tx_context;
-    
-    QueueHandle_t free_queue = args->free_mem_queue;
-    
-    TxBuffer buf = {};
-    
-    BaseType_t xTaskWokenByReceive = pdFALSE;
-    // xSemaphoreTakeFromISR(mutex, &xTaskWokenByReceive);
-    xQueueReceiveFromISR(queue, static_cast<TxBuffer*>(&buf), &xTaskWokenByReceive); //remove from the queue
-    // xSemaphoreGiveFromISR(mutex, &xTaskWokenByReceive);
 
-    if (buf.data != nullptr){
-        xQueueSendFromISR(free_queue, &buf.data, &xTaskWokenByReceive);
+    if (ring != nullptr){
+        //transmissions complete in order - the oldest slot is free again
+        ring->tail = (ring->tail + 1) % TX_QUEUE_DEPTH;
+        xSemaphoreGiveFromISR(ring->free_slots, &high_task_wakeup);
     }
 
     if (encoder_context != nullptr){
-        encoder_context->bit_index = 0;
-        encoder_context->byte_index = 0;
-        encoder_context->num_symbols = 0;
+        RMTCodec::reset_encoder_context(encoder_context);
     }
     
     xSemaphoreGiveFromISR(sem, &high_task_wakeup);
@@ -179,27 +287,54 @@ esp_err_t RMTManager::wait_until_send_complete(uint8_t channel_num){
         return ESP_FAIL;
     }
 
-    if(this->channels[channel_num].tx_done_semaphore == NULL){
+    if(this->channels[channel_num].tx_done_semaphore == NULL || this->channels[channel_num].isr == nullptr){
         return ESP_FAIL;
     }
 
-    if (xSemaphoreTake(this->channels[channel_num].tx_done_semaphore, pdMS_TO_TICKS(10000)) == pdTRUE){
-        return ESP_OK;
+    //`rmt_tx_done_callback` recycles one slot per finished transmission - the channel is idle once the driver owns
+    //no slot. The semaphore only wakes this task up, so a stale give (eg. nobody waited on the last transmission)
+    //just re-checks the ring
+    TxSlotRing* ring = &channels[channel_num].isr->tx_slots;
+    while (uxSemaphoreGetCount(ring->free_slots) + (ring->acquired ? 1 : 0) < TX_QUEUE_DEPTH){
+        if (xSemaphoreTake(this->channels[channel_num].tx_done_semaphore, pdMS_TO_TICKS(10000)) != pdTRUE){
+            ESP_LOGE(DEBUG_TAG, "Timeout of 10000 ms when waiting for RMT TX to complete");
+            return ESP_FAIL;
+        }
     }
 
-    ESP_LOGE(DEBUG_TAG, "Timeout of 10000 ms when waiting for RMT TX to complete");
-    return ESP_FAIL;
+    return ESP_OK;
 }
 
+/**
+ * @brief Decodes the symbols the RMT driver just received into the frame being received. With partial RX this is
+ * called every time the RX buffer fills up (`is_last` not set) and the driver receives into the same buffer again once
+ * it returns, so the chunk has to be decoded here. The decoded frame is sent to `receive` after the last chunk
+ *
+ * @param channel
+ * @param edata
+ * @param user_data `RxCallbackContext` of the channel
+ * @return whether a task was woken up
+ */
 bool RMTManager::rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data){
     BaseType_t high_task_wakeup = pdFALSE;
-    QueueHandle_t receive_queue = (QueueHandle_t)user_data;
-    // send the received RMT symbols to the parser task
-    BaseType_t res = xQueueSendFromISR(receive_queue, edata, &high_task_wakeup);
-    // if (res != pdTRUE){
-    //     // printf("RX Callback: Failed to enqueue received data\n");
-    //     // ESP_LOGE(DEBUG_TAG, "RX Callback: Failed to enqueue received data");
-    // }
+    RxCallbackContext* ctx = (RxCallbackContext*)user_data;
+    uint8_t* frame = ctx->frames[ctx->frame_index];
+
+    if (!ctx->in_frame){
+        ctx->decoder_context.line_code = ctx->line_code; //`set_line_code` may have been called since the RX job was armed
+        ctx->in_frame = true;
+    }
+    RMTCodec::decode_chunk(edata->received_symbols, edata->num_symbols, frame, ctx->mtu, &ctx->decoder_context);
+    if (!edata->flags.is_last){
+        return false;
+    }
+
+    RxFrame rx_frame = {
+        .data = frame,
+        .length = RMTCodec::finish_decoding(frame, ctx->mtu, &ctx->decoder_context),
+    };
+    ctx->in_frame = false;
+    xQueueSendFromISR(ctx->rx_queue, &rx_frame, &high_task_wakeup);
     // return whether any task is woken up
     return high_task_wakeup == pdTRUE;
 }
@@ -210,17 +345,27 @@ esp_err_t RMTManager::init_rx_channel(){
             .gpio_num = rx_gpio[i],
             .clk_src = RMT_CLK_SRC_DEFAULT,
             .resolution_hz = RMT_RESOLUTION_HZ,
-            .mem_block_symbols = RMT_SYMBOL_BLOCK_SIZE,
+            .mem_block_symbols = config.with_dma ? RMT_DMA_SYMBOL_BLOCK_SIZE : RMT_SYMBOL_BLOCK_SIZE,
             .flags = {
                 .invert_in = false,
-                .with_dma = 0
+                .with_dma = config.with_dma
             }
         }; //temp for one rx channel
     
         //temp
         channels[i].rx_gpio = rx_gpio[i];
+        channels[i].receive_config = receive_config;
+        channels[i].receive_config.signal_range_min_ns = RMT_RX_GLITCH_NS(RMT_DURATION_SYMBOL);
+        channels[i].rx_symbol_duration = RMT_DURATION_SYMBOL;
         
         esp_err_t res_rx = rmt_new_rx_channel(&rx_channel_config, &channels[i].rx_rmt_handle);
+        if (res_rx == ESP_ERR_NOT_FOUND && rx_channel_config.flags.with_dma){
+            //no DMA capable RX channel left - the driver copies out of the channel memory (ping-pong) instead
+            ESP_LOGW(DEBUG_TAG, "No DMA RX channel left for channel %d, falling back to non-DMA", i);
+            rx_channel_config.mem_block_symbols = RMT_SYMBOL_BLOCK_SIZE;
+            rx_channel_config.flags.with_dma = 0;
+            res_rx = rmt_new_rx_channel(&rx_channel_config, &channels[i].rx_rmt_handle);
+        }
     
         if (res_rx != ESP_OK) {
             // printf("Failed to init RX channel - reason %s\n", esp_err_to_name(res_rx));
@@ -234,12 +379,14 @@ esp_err_t RMTManager::init_rx_channel(){
             return ESP_FAIL;
         }
     
-        channels[i].rx_queue = xQueueCreate(QUEUE_SIZE, sizeof(rmt_rx_done_event_data_t)); //creating queue with some random size
+        channels[i].rx_queue = xQueueCreate(QUEUE_SIZE, sizeof(RxFrame)); //creating queue with some random size
+        channels[i].isr->rx_context.rx_queue = channels[i].rx_queue;
+        channels[i].isr->rx_context.line_code = LineCode::MANCHESTER;
     
         rmt_rx_event_callbacks_t cbs = {
             .on_recv_done = RMTManager::rmt_rx_done_callback
         };
-        rmt_rx_register_event_callbacks(channels[i].rx_rmt_handle, &cbs, channels[i].rx_queue);
+        rmt_rx_register_event_callbacks(channels[i].rx_rmt_handle, &cbs, &channels[i].isr->rx_context);
 
         res_rx = rmt_enable(channels[i].rx_rmt_handle);
     
@@ -272,7 +419,8 @@ esp_err_t RMTManager::init(){
     }
 
     for (uint8_t i = 0; i < num_channels; i++){
-        if (channels[i].tx_rmt_handle != NULL && channels[i].rx_rmt_handle != NULL && channels[i].tx_done_semaphore != NULL && channels[i].rx_queue != NULL){
+        if (channels[i].tx_rmt_handle != NULL && channels[i].rx_rmt_handle != NULL && channels[i].tx_done_semaphore != NULL && channels[i].rx_queue != NULL
+            && channels[i].isr->tx_slots.free_slots != NULL){
             channels[i].status = CHANNEL_READY_STATUS;
         }
     }
@@ -284,243 +432,122 @@ esp_err_t RMTManager::init(){
     return ESP_OK;
 }
 
-[[noreturn]] void RMTManager::freeMemory(void* args){
-    QueueHandle_t queue = (QueueHandle_t)(args);
-
-    uint8_t* dummy;
-
-    while (true){
-        if (xQueueReceive(queue, &dummy, pdMS_TO_TICKS(10)) == pdTRUE){
-            if (dummy != nullptr){
-                vPortFree((void*)dummy);
-            }
-        }
-
-    }
-}
-
 /**
- * @brief This is a callback function called by RMT when transmitting. This function will encode the user data `data` with rising and falling edges based on the bit.a64l
- * The symbols are defined in `RMTManager.h`, where a bit 1 is transmitted as a `RMT_SYMBOL_ONE` and a bit 0 is transmitted as a `RMT_SYMBOL_ZERO`
+ * @brief Sends the string `data` of size `size` on channel `channel_num`. `data` is copied into the next free TX slot
  * 
- * @param data
- * @param data_size
- * @param symbols_written
- * @param symbols_free
- * @param symbols
- * @param done
- * @param arg
+ * @param data 
+ * @param size 
+ * @param channel_num 
+ * @return esp_err_t 
  */
-size_t RMTManager::encoder_callback(const void* data, size_t data_size, size_t symbols_written, 
-            size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg){      
+esp_err_t RMTManager::send(const uint8_t* data, size_t size, uint8_t channel_num){
+    if (channel_num >= num_channels){
+        ESP_LOGE(DEBUG_TAG, "send() error: invalid channel number");
+        return ESP_FAIL;
+    }
 
-    rmt_encoder_context_t* ctx = (rmt_encoder_context_t*) arg; //get the current context
-    if (symbols_free == 0){ //no space in the tx buffer; don't encode any more bytes until there is space left
-        *done = (ctx->byte_index >= data_size);
-        return 0;
+    if (data == nullptr || size == 0 || size > config.mtu) {
+        // printf("send() error: data pointer NULL or size 0\n");
+        ESP_LOGE(DEBUG_TAG, "send() error: data pointer NULL or size 0. size: %d", size);
+        return ESP_FAIL;
     }
-    const uint8_t* bytes = (const uint8_t*)data; //get the user data as an array of bytes
-    size_t symbols_used = 0; //number of symbols used
-    while (ctx->byte_index < data_size && symbols_used < symbols_free){ //loop until we have reached the end of the data or filled the RMT symbol buffer (`symbols_free`)
-        uint8_t byte = bytes[ctx->byte_index]; //get the byte from the data
-        uint8_t bit = (byte >> (7 - ctx->bit_index)) & 0x01; //get the current bit, as determined from the bit index (MSB first)
-        
-        //Manchester (Ethernet Standard) Encoding 
-        symbols[symbols_used++] = bit ? RMT_SYMBOL_ONE : RMT_SYMBOL_ZERO; //if the bit is a 1, transmit a 1 symbol; otherwise, transmit 0 symbol
-        ctx->num_symbols++;
-
-        ctx->bit_index++;
-        if (ctx->bit_index >= 8) { 
-            //reached the end of the byte; go to the next byte
-            ctx->bit_index = 0;
-            ctx->byte_index++;
-        }
+
+    uint8_t* slot = nullptr;
+    size_t capacity = 0;
+    esp_err_t res = acquire_tx_slot(channel_num, &slot, &capacity);
+    if (res != ESP_OK){
+        return res;
     }
 
-    *done = (ctx->byte_index >= data_size); //if the transmit is done, set the `done` flag to true (all bytes have been encoded)
-    ESP_LOGD(DEBUG_TAG, "RMTManager::encoder_callback returned %d", *done);
-    return symbols_used;
-}
+    memcpy(slot, data, size);
 
-void RMTManager::reset_encoder_context(rmt_encoder_context_t* ctx){
-    ctx->bit_index = 0;
-    ctx->byte_index = 0;
-    ctx->num_symbols = 0;
+    return commit_tx_slot(channel_num, size);
 }
 
 /**
- * @brief Sends the string `data` of size `size`, with config `config`
- * 
- * @param data 
- * @param size 
- * @param config 
- * @return int 
+ * @brief Hands out the next free TX slot of `channel_num` so the caller can write the bytes to transmit directly into it.
+ * Blocks for up to `MUTEX_MAX_WAIT_TICKS` if every slot is still owned by the RMT driver
+ *
+ * @note Only one slot per channel can be acquired at a time; it must be given back with `commit_tx_slot`
+ *
+ * @param channel_num
+ * @param buf Pointer to the slot (will be written)
+ * @param capacity Size of the slot (will be written)
+ * @return esp_err_t
  */
-esp_err_t RMTManager::send(uint8_t* data, size_t size, rmt_transmit_config_t* config, uint8_t channel_num){
-    if (channel_num >= num_channels){
-        ESP_LOGE(DEBUG_TAG, "send() error: invalid channel number");
-        return ESP_FAIL;
+esp_err_t RMTManager::acquire_tx_slot(uint8_t channel_num, uint8_t** buf, size_t* capacity){
+    if (channel_num >= num_channels || buf == nullptr || capacity == nullptr){
+        return ESP_ERR_INVALID_ARG;
     }
 
     if (channels[channel_num].status == CHANNEL_NOT_READY_STATUS){
-        ESP_LOGE(DEBUG_TAG, "send() error: Channel %d is not ready", channel_num);
+        ESP_LOGE(DEBUG_TAG, "acquire_tx_slot() error: Channel %d is not ready", channel_num);
         return ESP_FAIL;
     }
 
-    if (this->channels[channel_num].tx_rmt_handle == nullptr) {
-        // printf("send() error: tx_chan is NULL\n");
-        ESP_LOGE(DEBUG_TAG, "send() error: tx_rmt_handle is NULL");
-        return ESP_FAIL;
-    }
-    if (this->channels[channel_num].tx_queue == nullptr) {
-        // printf("send() error: tx_chan is NULL\n");
-        ESP_LOGE(DEBUG_TAG, "send() error: tx_queue is NULL");
-        return ESP_FAIL;
-    }
-    if (this->channels[channel_num].encoder == nullptr) {
-        // printf("send() error: encoder is NULL\n");
-        ESP_LOGE(DEBUG_TAG, "send() error: encoder is NULL");
-        return ESP_FAIL;
-    }
-    if (data == nullptr || size == 0 || size > (RMT_SYMBOL_BLOCK_SIZE*4)) {
-        // printf("send() error: data pointer NULL or size 0\n");
-        ESP_LOGE(DEBUG_TAG, "send() error: data pointer NULL or size 0. size: %d", size);
-        return ESP_FAIL;
-    }
-    if (config == nullptr) {
-        // printf("send() error: config pointer is NULL\n");
-        ESP_LOGE(DEBUG_TAG, "send() error: config pointer is NULL");
+    if (channels[channel_num].tx_rmt_handle == nullptr || channels[channel_num].encoder == nullptr) {
+        ESP_LOGE(DEBUG_TAG, "acquire_tx_slot() error: tx_rmt_handle or encoder is NULL");
         return ESP_FAIL;
     }
 
-    TxBuffer new_data_to_send_buf = {
-        .data = (uint8_t*)pvPortMalloc(size), //this may not be thread safe but each channel should be on its own thread so maybe it's ok???
-        .length = size
-    };
+    TxSlotRing* ring = &channels[channel_num].isr->tx_slots;
 
-    if (new_data_to_send_buf.data == nullptr){
-        ESP_LOGE(DEBUG_TAG, "failed to malloc");
-        return ESP_FAIL;
+    if (ring->acquired){
+        ESP_LOGE(DEBUG_TAG, "acquire_tx_slot() error: channel %d already has an uncommitted slot", channel_num);
+        return ESP_ERR_INVALID_STATE;
     }
 
-    memcpy(new_data_to_send_buf.data, data, size);
-
-    if (xQueueSendToBack(channels[channel_num].tx_queue, &new_data_to_send_buf, (TickType_t) MUTEX_MAX_WAIT_TICKS) != pdPASS){
-        vPortFree(new_data_to_send_buf.data);
-        ESP_LOGE(DEBUG_TAG, "Failed to queue data");
-        return ESP_FAIL;
-    } 
-
-    esp_err_t res = rmt_transmit(this->channels[channel_num].tx_rmt_handle, this->channels[channel_num].encoder, new_data_to_send_buf.data, new_data_to_send_buf.length, config);
-
-    if (res != ESP_OK){
-        // printf("Failed to send %s\n", data);
-        vPortFree((void*)new_data_to_send_buf.data);
-        ESP_LOGE(DEBUG_TAG, "Failed to send %s", data);
-        return ESP_FAIL;
+    if (xSemaphoreTake(ring->free_slots, (TickType_t) MUTEX_MAX_WAIT_TICKS) != pdTRUE){
+        ESP_LOGE(DEBUG_TAG, "acquire_tx_slot() error: no free TX slot on channel %d", channel_num);
+        return ESP_ERR_TIMEOUT;
     }
-    // ESP_LOGI(DEBUG_TAG, "RMTManager started transmit job to channel %d", channel_num);
+
+    ring->acquired = true;
+    *buf = ring->slots[ring->head].data;
+    *capacity = config.mtu;
     return ESP_OK;
 }
 
 /**
- * @brief This function, given the `symbols` and the length `num`, will convert the received symbols into the symbols defined in `RMTSymbols.h`
- * this somehow works first try????? (tested with 't', 'O', and 'THIS IS A SAMPLE TEXT MESSAGE')
- * @param symbols received symbols 
- * @param num number of received symbols
- * @param decoded decoded symbol string
- * @param output_num size of `decoded`
- * @return int - returns the number of symbols written to the buffer
+ * @brief Starts transmitting the first `size` bytes of the slot handed out by `acquire_tx_slot`.
+ * A `size` of 0 gives the slot back without transmitting. The slot is recycled by `rmt_tx_done_callback`
+ *
+ * @param channel_num
+ * @param size
+ * @return esp_err_t
  */
-int RMTManager::decode_symbols(rmt_symbol_word_t* symbols, size_t num, rmt_symbol_word_t* decoded, size_t output_num){
-    if (symbols == NULL || decoded == NULL || num == 0 || output_num == 0){
-        return ESP_FAIL;
+esp_err_t RMTManager::commit_tx_slot(uint8_t channel_num, size_t size){
+    if (channel_num >= num_channels || size > config.mtu){
+        return ESP_ERR_INVALID_ARG;
     }
 
-    size_t output_index = 0;
-    size_t i = 0;
-    bool curr_high_low = true; //flag to maintain where we are (either high or low)
-
-    while (output_index < output_num && i < num){
-        // printf("duration0 %d level0 %d duration1 %d level1 %d\n", symbols[i].duration0, symbols[i].level0, symbols[i].duration1, symbols[i].level1); //dummy print receive
-        //manchester encoding
-        /*there are two cases in the beginning:
-        1. if duration0 = 20, then we are in between two symbols (low to high and high to low). 
-        in this case, we need to insert a low in the beginning and "split" the current symbol into 2
-        2. if duration0 = 10, then the first symbol should be high to low
-        */
-        if (symbols[i].duration0 != RMT_DURATION_SYMBOL){
-            if (i != 0){
-                if (curr_high_low){
-                    decoded[output_index++] = RMT_SYMBOL_ONE;
-                } else {
-                    decoded[output_index++] = RMT_SYMBOL_ZERO;
-                }
-                curr_high_low = !curr_high_low;
-            } else {
-                //need to insert a 0 before received symbols
-                decoded[output_index++] = RMT_SYMBOL_ZERO;
-            }
-        
-        }
-        
-        if (curr_high_low){
-            decoded[output_index++] = RMT_SYMBOL_ONE;
-        } else {
-            decoded[output_index++] = RMT_SYMBOL_ZERO;
-        }
-        
-        //if duration1 = 20, then we are starting low
-        if (symbols[i].duration1 != RMT_DURATION_SYMBOL){
-            curr_high_low = !curr_high_low;
-        }
-        i++;
-        
+    TxSlotRing* ring = &channels[channel_num].isr->tx_slots;
+    if (!ring->acquired){
+        ESP_LOGE(DEBUG_TAG, "commit_tx_slot() error: no slot was acquired on channel %d", channel_num);
+        return ESP_ERR_INVALID_STATE;
     }
+    ring->acquired = false;
 
-    return (int)output_index;
-}
-
-/**
- * @brief This converts the parsed symbols into a string of size `output_index`
- * 
- * @param symbols Parsed received symbols (see `RMTSymbols.h` for the definitions of the symbols)
- * @param num Length of `symbols`
- * @param string Output string encoded by the symbols
- * @param output_num `length of the char array`
- * @return int - length of the output string (-1 if failure)
- */
-int RMTManager::convert_symbols_to_char(rmt_symbol_word_t* symbols, size_t num, uint8_t* string, size_t output_num){
-    if (symbols == NULL || string == NULL || num == 0 || output_num == 0){
-        return ESP_FAIL;
+    if (size == 0){
+        xSemaphoreGive(ring->free_slots);
+        return ESP_OK;
     }
-    size_t bit_count = 0;
-    char byte = 0;
-    size_t output_index = 0;
-    int i = 0;
-    
-    while (i < num && output_index < output_num){
-        if (symbols[i].level0 == 0 && symbols[i].level1 == 1){
-            //zero
-            byte = byte << 1;
-        }else if (symbols[i].level0 == 1 && symbols[i].level1 == 0) {
-            byte = (byte << 1) + 1;
-        } else {
-            return ESP_FAIL;
-        }
 
-        bit_count++;
-        if (bit_count == 8){
-            //a byte has been parsed
-            // printf("inserting %b\n", byte);
-            string[output_index++] = byte;
-            byte = 0;
-            bit_count = 0;
-        }
-        i++;
+    TxSlot* slot = &ring->slots[ring->head];
+    slot->length = size;
+    ring->head = (ring->head + 1) % TX_QUEUE_DEPTH;
+
+    esp_err_t res = rmt_transmit(this->channels[channel_num].tx_rmt_handle, this->channels[channel_num].encoder, slot->data, slot->length, &this->transmit_config);
+
+    if (res != ESP_OK){
+        //the driver never took the slot - hand it out again next time
+        ring->head = (ring->head + TX_QUEUE_DEPTH - 1) % TX_QUEUE_DEPTH;
+        xSemaphoreGive(ring->free_slots);
+        ESP_LOGE(DEBUG_TAG, "Failed to send on channel %d", channel_num);
+        return ESP_FAIL;
     }
-    // printf("output_index %d\n", output_index);
-    return (int)output_index;
+    // ESP_LOGI(DEBUG_TAG, "RMTManager started transmit job to channel %d", channel_num);
+    return ESP_OK;
 }
 
 /**
@@ -547,10 +574,17 @@ esp_err_t RMTManager::start_receiving(uint8_t channel_num){
         return ESP_FAIL;
     }
 
-    esp_err_t res = rmt_receive(channels[channel_num].rx_rmt_handle, channels[channel_num].raw_symbols, sizeof(channels[channel_num].raw_symbols), &this->receive_config);
+    //no RX job is armed, so the RX done callback is not touching the decoder
+    RxCallbackContext* rx_context = &channels[channel_num].isr->rx_context;
+    RMTCodec::reset_decoder_context(&rx_context->decoder_context);
+    rx_context->decoder_context.symbol_duration = channels[channel_num].rx_symbol_duration;
+    rx_context->in_frame = false;
+
+    esp_err_t res = rmt_receive(channels[channel_num].rx_rmt_handle, channels[channel_num].raw_symbols, RMT_RX_CHUNK_SYMBOLS * sizeof(rmt_symbol_word_t), &channels[channel_num].receive_config);
 
     if (res != ESP_OK){
         ESP_LOGE(DEBUG_TAG, "Failed to start receive");
+        return res; //stay ready so the next call retries
     }
 
     channels[channel_num].status = CHANNEL_LISTENING;
@@ -559,7 +593,8 @@ esp_err_t RMTManager::start_receiving(uint8_t channel_num){
 }
 
 /**
- * @brief Function to get the received messages
+ * @brief Function to get the received messages. Blocks for up to `RECEIVE_WAIT_MS` until a frame arrives on `channel_num`
+ * (decoded by `rmt_rx_done_callback` as it is received), then restarts the RX job before copying the frame out
  * 
  * @param recv_buf Byte array of the received bytes
  * @param size Size of the byte array
@@ -573,35 +608,36 @@ esp_err_t RMTManager::receive(uint8_t* recv_buf, size_t size, size_t* output_siz
         return ESP_FAIL;
     }
 
+    if (channels[channel_num].rx_symbol_duration != channels[channel_num].symbol_duration){
+        apply_rx_bit_rate(channel_num);
+    }
+
     if (channels[channel_num].status != CHANNEL_LISTENING){
         ESP_LOGE(DEBUG_TAG, "receive(): Receive channel %d is not ready to receive due to init fail or async job was not started", channel_num);
         return ESP_FAIL;
     }
 
-    rmt_rx_done_event_data_t rx_data;
-    if (xQueueReceive(channels[channel_num].rx_queue, &rx_data, pdMS_TO_TICKS(150)) != pdTRUE){ //this will wait until a message has arrived or not
+    RxFrame rx_frame;
+    if (xQueueReceive(channels[channel_num].rx_queue, &rx_frame, pdMS_TO_TICKS(RECEIVE_WAIT_MS)) != pdTRUE){ //this will wait until a message has arrived or not
         // printf("Timeout occurred while waiting for RX event\n");
         // ESP_LOGE(DEBUG_TAG, "Timeout occurred while waiting for RX event - didn't receive a message in time");
         return ESP_FAIL;
     }
 
+    //re-arm RX on the other frame buffer right away so the next frame is not missed while this one is copied out
     channels[channel_num].status = CHANNEL_READY_STATUS;
-
-    // printf("Got %d symbols\n", rx_data.num_symbols);
-    // printf("raw symbols:\n");
-    // for (int i = 0; i < rx_data.num_symbols; i++){
-    //     printf("duration0 %d level0 %d duration1 %d level1 %d\n", rx_data.received_symbols[i].duration0, rx_data.received_symbols[i].level0, rx_data.received_symbols[i].duration1, rx_data.received_symbols[i].level1);
-    // }
-
-    int num = this->decode_symbols(rx_data.received_symbols, rx_data.num_symbols, channels[channel_num].decoded_recv_symbols, sizeof(channels[channel_num].decoded_recv_symbols));
-    if (num < 0){
-        return ESP_FAIL;
+    channels[channel_num].isr->rx_context.frame_index ^= 1;
+    if (start_receiving(channel_num) != ESP_OK){
+        ESP_LOGE(DEBUG_TAG, "receive(): Failed to restart RX job on channel %d", channel_num);
     }
-    
-    *output_size = this->convert_symbols_to_char(channels[channel_num].decoded_recv_symbols, num, recv_buf, size);
-    if (*output_size < 0){
+
+    if (rx_frame.length < 0){
         return ESP_FAIL;
     }
+
+    size_t num = (size_t)rx_frame.length < size ? (size_t)rx_frame.length : size;
+    memcpy(recv_buf, rx_frame.data, num);
+    *output_size = num;
     
     //UNCOMMENT HERE TO GET RAW BITS TO USE IN `components/dataLink/test_scripts/parse_bit_frame.py`
     // printf("\n\nparsed characters:\n");
@@ -629,5 +665,168 @@ RMTManager::~RMTManager(){
         if (channels[i].rx_queue) {
             vQueueDelete(channels[i].rx_queue);
         }
+        if (channels[i].isr->tx_slots.free_slots) {
+            vSemaphoreDelete(channels[i].isr->tx_slots.free_slots);
+        }
+        free_channel_buffers(i);
+    }
+    free_channels();
+}
+
+/**
+ * @brief Max number of bytes in a single transmission (`send`/`commit_tx_slot`) on any channel
+ *
+ * @return size_t
+ */
+size_t RMTManager::get_mtu() const{
+    return config.mtu;
+}
+
+/**
+ * @brief Bit rate (bits/s) of `line_code` when its shortest pulse lasts `duration` ticks
+ *
+ */
+static uint32_t line_code_bit_rate(LineCode line_code, uint16_t duration){
+    if (duration == 0){
+        return 0;
+    }
+    return line_code == LineCode::NRZI_4B5B ? RMT_4B5B_BIT_RATE(duration) : RMT_BIT_RATE(duration);
+}
+
+/**
+ * @brief Shortest pulse (ticks) that sends `line_code` at exactly `bit_rate`
+ *
+ * @return uint16_t 0 if `bit_rate` is not a whole number of ticks between `RMT_MIN_DURATION_SYMBOL` and `RMT_MAX_DURATION_SYMBOL`
+ */
+static uint16_t line_code_duration(LineCode line_code, uint32_t bit_rate){
+    if (bit_rate == 0){
+        return 0;
+    }
+
+    uint32_t duration = line_code == LineCode::NRZI_4B5B ? (uint32_t)(4ULL * RMT_RESOLUTION_HZ / (5ULL * bit_rate)) : RMT_RESOLUTION_HZ / (2 * bit_rate);
+    if (duration < RMT_MIN_DURATION_SYMBOL || duration > RMT_MAX_DURATION_SYMBOL || line_code_bit_rate(line_code, duration) != bit_rate){
+        return 0;
+    }
+    return (uint16_t)duration;
+}
+
+/**
+ * @brief Bit rate (bits/s) of `channel_num`
+ *
+ * @param channel_num
+ * @return uint32_t 0 if the channel does not exist
+ */
+uint32_t RMTManager::get_bit_rate(uint8_t channel_num) const{
+    if (channel_num >= num_channels){
+        return 0;
+    }
+    return line_code_bit_rate(channels[channel_num].line_code, channels[channel_num].symbol_duration);
+}
+
+bool RMTManager::supports_bit_rate(LineCode line_code, uint32_t bit_rate) const{
+    return line_code_duration(line_code, bit_rate) != 0;
+}
+
+/**
+ * @brief Changes the shortest pulse of `channel_num` to send and receive at `bit_rate` with its current line code.
+ * Transmissions that are already queued finish at the old bit rate first. RX switches over on the next `receive`
+ *
+ * @note Both ends of a link must use the same bit rate
+ *
+ * @param channel_num
+ * @param bit_rate Must be a whole number of ticks between `RMT_MIN_DURATION_SYMBOL` and `RMT_MAX_DURATION_SYMBOL` (see `supports_bit_rate`)
+ * @return esp_err_t `ESP_ERR_NOT_SUPPORTED` if the bit rate cannot be produced
+ */
+esp_err_t RMTManager::set_bit_rate(uint8_t channel_num, uint32_t bit_rate){
+    if (channel_num >= num_channels || bit_rate == 0){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint16_t duration = line_code_duration(channels[channel_num].line_code, bit_rate);
+    if (duration == 0){
+        ESP_LOGE(DEBUG_TAG, "Bit rate %lu is not supported", (unsigned long)bit_rate);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (channels[channel_num].status == CHANNEL_NOT_READY_STATUS){
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (rmt_tx_wait_all_done(channels[channel_num].tx_rmt_handle, RMT_BIT_RATE_SWITCH_WAIT_MS) != ESP_OK){
+        ESP_LOGE(DEBUG_TAG, "Timed out waiting for channel %d to finish transmitting", channel_num);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    //nothing is being encoded at this point, so the encoder context can be changed
+    channels[channel_num].isr->encoder_context.symbol_durations = RMT_SYMBOL_DURATIONS(duration);
+    channels[channel_num].symbol_duration = duration;
+
+    ESP_LOGI(DEBUG_TAG, "Channel %d bit rate set to %lu", channel_num, (unsigned long)bit_rate);
+    return ESP_OK;
+}
+
+LineCode RMTManager::get_line_code(uint8_t channel_num) const{
+    if (channel_num >= num_channels){
+        return LineCode::MANCHESTER;
+    }
+    return channels[channel_num].line_code;
+}
+
+/**
+ * @brief Changes the line code of `channel_num`. The shortest pulse stays the same, so the bit rate changes with it
+ * (eg. 1 Mbps Manchester becomes 1.6 Mbps 4B/5B + NRZI). Transmissions that are already queued finish with the old
+ * line code first
+ *
+ * @note Both ends of a link must use the same line code
+ *
+ * @param channel_num
+ * @param line_code
+ * @return esp_err_t
+ */
+esp_err_t RMTManager::set_line_code(uint8_t channel_num, LineCode line_code){
+    if (channel_num >= num_channels || (line_code != LineCode::MANCHESTER && line_code != LineCode::NRZI_4B5B)){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (channels[channel_num].status == CHANNEL_NOT_READY_STATUS){
+        return ESP_ERR_INVALID_STATE;
     }
-}
\ No newline at end of file
+
+    if (rmt_tx_wait_all_done(channels[channel_num].tx_rmt_handle, RMT_BIT_RATE_SWITCH_WAIT_MS) != ESP_OK){
+        ESP_LOGE(DEBUG_TAG, "Timed out waiting for channel %d to finish transmitting", channel_num);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    //the RX job does not depend on the line code (same shortest pulse) - only the decoder changes, from the next frame on
+    channels[channel_num].isr->encoder_context.line_code = line_code;
+    channels[channel_num].isr->rx_context.line_code = line_code;
+    channels[channel_num].line_code = line_code;
+
+    ESP_LOGI(DEBUG_TAG, "Channel %d line code set to %d", channel_num, static_cast<int>(line_code));
+    return ESP_OK;
+}
+
+/**
+ * @brief Re-arms the RX job of `channel_num` with the glitch filter and decoder tolerance of its new bit rate.
+ * Only called from `receive` so the RX job is never restarted by two tasks at once
+ *
+ * @param channel_num
+ * @return esp_err_t
+ */
+esp_err_t RMTManager::apply_rx_bit_rate(uint8_t channel_num){
+    rmt_channel* channel = &channels[channel_num];
+    uint16_t duration = channel->symbol_duration;
+
+    if (channel->status == CHANNEL_LISTENING){
+        //the armed job would filter out every pulse shorter than the old glitch filter - abort it
+        rmt_disable(channel->rx_rmt_handle);
+        rmt_enable(channel->rx_rmt_handle);
+        xQueueReset(channel->rx_queue);
+        channel->status = CHANNEL_READY_STATUS;
+    }
+
+    channel->receive_config.signal_range_min_ns = RMT_RX_GLITCH_NS(duration);
+    channel->rx_symbol_duration = duration;
+
+    return start_receiving(channel_num);
+}
@@ -0,0 +1,427 @@
+#include <cstring>
+
+#include "VirtualWireManager.h"
+#include "esp_log.h"
+
+/**
+ * @brief Construct a new VirtualWire object
+ *
+ * @param num_nodes Number of simulated boards attached to this wire (1-`VIRTUAL_WIRE_MAX_NODES`) inclusive
+ */
+VirtualWire::VirtualWire(uint8_t num_nodes){
+    if (num_nodes > VIRTUAL_WIRE_MAX_NODES || num_nodes == 0){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Invalid number of nodes %d", num_nodes);
+        num_nodes = 0;
+    }
+    this->num_nodes = num_nodes;
+    topology_mutex = xSemaphoreCreateMutex();
+
+    for (uint8_t node = 0; node < VIRTUAL_WIRE_MAX_NODES; node++){
+        for (uint8_t channel = 0; channel < MAX_CHANNELS; channel++){
+            bit_rates[node][channel] = VIRTUAL_WIRE_DEFAULT_BIT_RATE;
+        }
+    }
+}
+
+VirtualWire::~VirtualWire(){
+    for (uint8_t node = 0; node < num_nodes; node++){
+        for (uint8_t channel = 0; channel < MAX_CHANNELS; channel++){
+            if (rx_queues[node][channel] != NULL){
+                VirtualWireFrame frame;
+                while (xQueueReceive(rx_queues[node][channel], &frame, 0) == pdTRUE){
+                    delete[] frame.data;
+                }
+                vQueueDelete(rx_queues[node][channel]);
+            }
+        }
+    }
+
+    if (topology_mutex != NULL){
+        vSemaphoreDelete(topology_mutex);
+    }
+}
+
+bool VirtualWire::valid_endpoint(uint8_t node, uint8_t channel){
+    return node < num_nodes && channel < MAX_CHANNELS;
+}
+
+/**
+ * @brief Wires the TX/RX pair of `channel_a` on `node_a` to the TX/RX pair of `channel_b` on `node_b`
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::connect(uint8_t node_a, uint8_t channel_a, uint8_t node_b, uint8_t channel_b){
+    if (!valid_endpoint(node_a, channel_a) || !valid_endpoint(node_b, channel_b)){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Invalid endpoint");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (node_a == node_b && channel_a == channel_b){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Cannot connect an endpoint to itself");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (peers[node_a][channel_a].connected || peers[node_b][channel_b].connected){
+        xSemaphoreGive(topology_mutex);
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Endpoint is already connected");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (rx_queues[node_a][channel_a] == NULL){
+        rx_queues[node_a][channel_a] = xQueueCreate(VIRTUAL_WIRE_QUEUE_SIZE, sizeof(VirtualWireFrame));
+    }
+    if (rx_queues[node_b][channel_b] == NULL){
+        rx_queues[node_b][channel_b] = xQueueCreate(VIRTUAL_WIRE_QUEUE_SIZE, sizeof(VirtualWireFrame));
+    }
+
+    if (rx_queues[node_a][channel_a] == NULL || rx_queues[node_b][channel_b] == NULL){
+        xSemaphoreGive(topology_mutex);
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Failed to create RX queues");
+        return ESP_ERR_NO_MEM;
+    }
+
+    peers[node_a][channel_a] = {
+        .node = node_b,
+        .channel = channel_b,
+        .connected = true,
+    };
+    peers[node_b][channel_b] = {
+        .node = node_a,
+        .channel = channel_a,
+        .connected = true,
+    };
+
+    xSemaphoreGive(topology_mutex);
+
+    ESP_LOGI(VIRTUAL_WIRE_DEBUG_TAG, "Connected node %d channel %d <-> node %d channel %d", node_a, channel_a, node_b, channel_b);
+    return ESP_OK;
+}
+
+/**
+ * @brief Puts `size` bytes of `data` onto the wire attached to `channel` of `node`
+ *
+ * @note Like a real wire, transmitting on an unplugged channel (or into a full RX queue, or at a different bit rate than
+ * the peer) succeeds but the frame is lost
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::transmit(uint8_t node, uint8_t channel, const uint8_t* data, size_t size){
+    if (!valid_endpoint(node, channel)){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (data == nullptr || size == 0 || size > VIRTUAL_WIRE_MTU){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "transmit() error: data pointer NULL or invalid size. size: %d", size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    VirtualWirePeer peer = peers[node][channel];
+    QueueHandle_t peer_queue = peer.connected ? rx_queues[peer.node][peer.channel] : NULL;
+
+    stats[node][channel].frames_tx++;
+    stats[node][channel].bytes_tx += size;
+
+    if (peer_queue == NULL || bit_rates[node][channel] != bit_rates[peer.node][peer.channel] ||
+        line_codes[node][channel] != line_codes[peer.node][peer.channel]){
+        stats[node][channel].frames_dropped++;
+        xSemaphoreGive(topology_mutex);
+        return ESP_OK;
+    }
+
+    VirtualWireFrame frame = {
+        .data = new uint8_t[size],
+        .length = size,
+    };
+    memcpy(frame.data, data, size);
+
+    if (max_bit_rates[node][channel] != 0 && bit_rates[node][channel] > max_bit_rates[node][channel]){
+        frame.data[size / 2] ^= 0x10;
+        stats[node][channel].frames_corrupted++;
+    }
+
+    if (xQueueSendToBack(peer_queue, &frame, 0) != pdPASS){
+        stats[node][channel].frames_dropped++;
+        delete[] frame.data;
+    }
+
+    xSemaphoreGive(topology_mutex);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Waits up to `max_wait` for a frame to arrive on `channel` of `node` and copies it into `buf`
+ *
+ * @param buf
+ * @param size Size of `buf` (longer frames are truncated)
+ * @param length Number of bytes written to `buf`
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::receive(uint8_t node, uint8_t channel, uint8_t* buf, size_t size, size_t* length, TickType_t max_wait){
+    if (!valid_endpoint(node, channel) || buf == nullptr || length == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    //queues are only created (never deleted) while the wire is alive, so it is safe to read the handle without the mutex
+    QueueHandle_t queue = rx_queues[node][channel];
+    if (queue == NULL){
+        //unplugged channel - nothing will ever arrive
+        vTaskDelay(max_wait);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    VirtualWireFrame frame;
+    if (xQueueReceive(queue, &frame, max_wait) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    *length = frame.length < size ? frame.length : size;
+    memcpy(buf, frame.data, *length);
+    delete[] frame.data;
+
+    return ESP_OK;
+}
+
+esp_err_t VirtualWire::get_stats(uint8_t node, uint8_t channel, VirtualWireStats* stats){
+    if (!valid_endpoint(node, channel) || stats == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    *stats = this->stats[node][channel];
+
+    xSemaphoreGive(topology_mutex);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Sets the bit rate `channel` of `node` transmits and receives at
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::set_bit_rate(uint8_t node, uint8_t channel, uint32_t bit_rate){
+    if (!valid_endpoint(node, channel) || bit_rate == 0){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    bit_rates[node][channel] = bit_rate;
+
+    xSemaphoreGive(topology_mutex);
+
+    return ESP_OK;
+}
+
+uint32_t VirtualWire::get_bit_rate(uint8_t node, uint8_t channel){
+    return valid_endpoint(node, channel) ? bit_rates[node][channel] : 0;
+}
+
+/**
+ * @brief Sets the line code `channel` of `node` transmits and receives with. The wire has no pulses, so the bit rate
+ * of the endpoint does not change
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::set_line_code(uint8_t node, uint8_t channel, LineCode line_code){
+    if (!valid_endpoint(node, channel)){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    line_codes[node][channel] = line_code;
+
+    xSemaphoreGive(topology_mutex);
+
+    return ESP_OK;
+}
+
+LineCode VirtualWire::get_line_code(uint8_t node, uint8_t channel){
+    return valid_endpoint(node, channel) ? line_codes[node][channel] : LineCode::MANCHESTER;
+}
+
+/**
+ * @brief Frames transmitted by `channel` of `node` above `max_bit_rate` will be corrupted (emulates a long or noisy cable)
+ *
+ * @param max_bit_rate 0 to remove the limit
+ * @return esp_err_t
+ */
+esp_err_t VirtualWire::set_max_bit_rate(uint8_t node, uint8_t channel, uint32_t max_bit_rate){
+    if (!valid_endpoint(node, channel)){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(topology_mutex, pdMS_TO_TICKS(VIRTUAL_WIRE_MUTEX_WAIT_MS)) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+
+    max_bit_rates[node][channel] = max_bit_rate;
+
+    xSemaphoreGive(topology_mutex);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Construct a new VirtualWireManager object
+ *
+ * @param wire Simulated wire shared by all the simulated boards
+ * @param node Index of this board on `wire`
+ * @param num_channels Number of channels to use (1-4) inclusive
+ * @param mtu Max number of bytes in a single transmission (1-`VIRTUAL_WIRE_MTU`) inclusive
+ */
+VirtualWireManager::VirtualWireManager(std::shared_ptr<VirtualWire> wire, uint8_t node, uint8_t num_channels, size_t mtu)
+    : wire(std::move(wire)), node(node), num_channels(num_channels), mtu(mtu){
+    if (num_channels > MAX_CHANNELS || num_channels == 0){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Invalid number of channels to init");
+        this->num_channels = 0;
+    }
+    if (mtu > VIRTUAL_WIRE_MTU || mtu == 0){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "Invalid MTU %d", mtu);
+        this->num_channels = 0;
+    }
+
+    for (uint8_t channel = 0; channel < this->num_channels; channel++){
+        tx_slots[channel] = std::make_unique<uint8_t[]>(mtu);
+    }
+}
+
+esp_err_t VirtualWireManager::send(const uint8_t* data, size_t size, uint8_t channel_num){
+    if (channel_num >= num_channels || wire == nullptr){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "send() error: invalid channel number");
+        return ESP_FAIL;
+    }
+
+    if (size > mtu){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "send() error: size %d is larger than the MTU", size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return wire->transmit(node, channel_num, data, size);
+}
+
+esp_err_t VirtualWireManager::acquire_tx_slot(uint8_t channel_num, uint8_t** buf, size_t* capacity){
+    if (channel_num >= num_channels || buf == nullptr || capacity == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (tx_slot_acquired[channel_num]){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "acquire_tx_slot() error: channel %d already has an uncommitted slot", channel_num);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    tx_slot_acquired[channel_num] = true;
+    *buf = tx_slots[channel_num].get();
+    *capacity = mtu;
+    return ESP_OK;
+}
+
+esp_err_t VirtualWireManager::commit_tx_slot(uint8_t channel_num, size_t size){
+    if (channel_num >= num_channels || size > mtu){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!tx_slot_acquired[channel_num]){
+        ESP_LOGE(VIRTUAL_WIRE_DEBUG_TAG, "commit_tx_slot() error: no slot was acquired on channel %d", channel_num);
+        return ESP_ERR_INVALID_STATE;
+    }
+    tx_slot_acquired[channel_num] = false;
+
+    if (size == 0){
+        return ESP_OK;
+    }
+
+    return send(tx_slots[channel_num].get(), size, channel_num);
+}
+
+size_t VirtualWireManager::get_mtu() const{
+    return mtu;
+}
+
+uint32_t VirtualWireManager::get_bit_rate(uint8_t channel_num) const{
+    if (channel_num >= num_channels || wire == nullptr){
+        return 0;
+    }
+    return wire->get_bit_rate(node, channel_num);
+}
+
+/**
+ * @brief Any non-zero bit rate is supported. Frames are lost until the peer switches to the same bit rate
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWireManager::set_bit_rate(uint8_t channel_num, uint32_t bit_rate){
+    if (channel_num >= num_channels || wire == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+    return wire->set_bit_rate(node, channel_num, bit_rate);
+}
+
+bool VirtualWireManager::supports_bit_rate(LineCode line_code, uint32_t bit_rate) const{
+    return bit_rate != 0;
+}
+
+LineCode VirtualWireManager::get_line_code(uint8_t channel_num) const{
+    if (channel_num >= num_channels || wire == nullptr){
+        return LineCode::MANCHESTER;
+    }
+    return wire->get_line_code(node, channel_num);
+}
+
+esp_err_t VirtualWireManager::set_line_code(uint8_t channel_num, LineCode line_code){
+    if (channel_num >= num_channels || wire == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+    return wire->set_line_code(node, channel_num, line_code);
+}
+
+esp_err_t VirtualWireManager::receive(uint8_t* recv_buf, size_t size, size_t* output_size, uint8_t channel_num){
+    if (channel_num >= num_channels || wire == nullptr){
+        return ESP_FAIL;
+    }
+
+    if (recv_buf == nullptr || output_size == nullptr){
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (wire->receive(node, channel_num, recv_buf, size, output_size, pdMS_TO_TICKS(VIRTUAL_WIRE_RX_WAIT_MS)) != ESP_OK){
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief The simulated wire is always listening. Kept for parity with `RMTManager::start_receiving`
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWireManager::start_receiving(uint8_t channel_num){
+    return channel_num < num_channels ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief Frames are delivered as soon as `send` returns, so there is nothing to wait for
+ *
+ * @return esp_err_t
+ */
+esp_err_t VirtualWireManager::wait_until_send_complete(uint8_t channel_num){
+    return channel_num < num_channels ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,117 @@
+#ifndef I_PHYSICAL_LAYER
+#define I_PHYSICAL_LAYER
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+#define MAX_CHANNELS 4
+#define PHY_MAX_MTU 4096 //largest MTU any physical layer supports (`RMT_MAX_MTU`, `VIRTUAL_WIRE_MTU`)
+
+/**
+ * @brief Line code a channel turns bytes into pulses with. Both ends of a link must use the same line code
+ *
+ */
+enum class LineCode : uint8_t {
+    MANCHESTER = 0, //2 pulses per bit, a transition in the middle of every bit (default)
+    NRZI_4B5B = 1, //4B/5B then NRZI: 5 pulses per 4 bits (1.6x the bit rate of Manchester with the same shortest pulse)
+};
+
+/**
+ * @brief Interface representing the Physical Layer used by the Data Link Layer
+ *
+ * Implemented by `RMTManager` (ESP32-S3 RMT peripheral) and `VirtualWireManager` (in-process simulated wire
+ * used to run the link layer on the IDF `linux` target)
+ *
+ */
+class IPhysicalLayer{
+    public:
+        virtual ~IPhysicalLayer() = default;
+
+        /**
+         * @brief Starts transmitting `size` bytes of `data` on the channel `channel_num`
+         *
+         * @note The data is copied by the physical layer; the caller may reuse `data` once this returns
+         */
+        virtual esp_err_t send(const uint8_t* data, size_t size, uint8_t channel_num) = 0;
+
+        /**
+         * @brief Max number of bytes in a single transmission (`send` or `commit_tx_slot`). Also the largest byte
+         * stream `receive` can return
+         */
+        virtual size_t get_mtu() const = 0;
+
+        /**
+         * @brief Bit rate (bits/s) the channel `channel_num` currently sends and receives at
+         */
+        virtual uint32_t get_bit_rate(uint8_t channel_num) const = 0;
+
+        /**
+         * @brief Changes the bit rate (bits/s) of the channel `channel_num` (both TX and RX)
+         *
+         * @note Both ends of a link must use the same bit rate. Returns `ESP_ERR_NOT_SUPPORTED` if the physical layer
+         * cannot produce `bit_rate`
+         */
+        virtual esp_err_t set_bit_rate(uint8_t channel_num, uint32_t bit_rate) = 0;
+
+        /**
+         * @brief Whether `set_bit_rate` can produce `bit_rate` with the line code `line_code`
+         */
+        virtual bool supports_bit_rate(LineCode line_code, uint32_t bit_rate) const = 0;
+
+        /**
+         * @brief Line code the channel `channel_num` currently sends and receives with
+         */
+        virtual LineCode get_line_code(uint8_t channel_num) const = 0;
+
+        /**
+         * @brief Changes the line code of the channel `channel_num` (both TX and RX)
+         *
+         * @note The shortest pulse stays the same, so the bit rate changes with the line code (see `get_bit_rate`).
+         * Both ends of a link must use the same line code
+         */
+        virtual esp_err_t set_line_code(uint8_t channel_num, LineCode line_code) = 0;
+
+        /**
+         * @brief Hands out the next free TX buffer of `channel_num` so a frame can be serialized directly into it
+         *
+         * @param buf Pointer to the TX buffer (will be written)
+         * @param capacity Size of the TX buffer (will be written)
+         * @note Only one buffer per channel can be acquired at a time; it must be given back with `commit_tx_slot`
+         */
+        virtual esp_err_t acquire_tx_slot(uint8_t channel_num, uint8_t** buf, size_t* capacity) = 0;
+
+        /**
+         * @brief Starts transmitting the first `size` bytes of the buffer handed out by `acquire_tx_slot`
+         *
+         * @note A `size` of 0 gives the buffer back without transmitting
+         */
+        virtual esp_err_t commit_tx_slot(uint8_t channel_num, size_t size) = 0;
+
+        /**
+         * @brief Blocks until the next byte stream is received on the channel `channel_num` (or a timeout)
+         *
+         * @note The channel keeps listening once a byte stream has been received, so `start_receiving` only has to be
+         * called once per channel (it is a no-op if the channel is already listening)
+         *
+         * @param recv_buf Byte array of the received bytes
+         * @param size Size of the byte array
+         * @param output_size Number of bytes written to `recv_buf`
+         * @param channel_num Physical channel pair to receive from
+         */
+        virtual esp_err_t receive(uint8_t* recv_buf, size_t size, size_t* output_size, uint8_t channel_num) = 0;
+
+        /**
+         * @brief Starts listening for the next byte stream on the channel `channel_num`
+         */
+        virtual esp_err_t start_receiving(uint8_t channel_num) = 0;
+
+        /**
+         * @brief Blocks until every transmission started on `channel_num` has left the wire (returns right away if
+         * the channel is idle)
+         */
+        virtual esp_err_t wait_until_send_complete(uint8_t channel_num) = 0;
+};
+
+#endif //I_PHYSICAL_LAYER
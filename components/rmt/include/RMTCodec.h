@@ -0,0 +1,65 @@
+#ifndef RMT_CODEC
+#define RMT_CODEC
+
+#include <cstddef>
+#include <cstdint>
+
+#include "IPhysicalLayer.h"
+#include "RMTSymbols.h"
+
+/**
+ * @brief This struct keeps track of the current byte and bit index of the user data being transmmitted via RMT
+ *
+ */
+typedef struct {
+    size_t byte_index; //which byte is currently being encoded when transmitting
+    uint8_t bit_index; //which bit in the `byte_index` is currently being encoded (into high/low waveforms)
+    size_t num_symbols; //temp
+    uint32_t symbol_durations; //`RMT_SYMBOL_DURATIONS` of the half bit duration of the channel (OR'd into every encoded symbol)
+    LineCode line_code; //line code of the channel (picks the encoder in `encoder_callback`)
+    uint32_t level_mask; //4B/5B + NRZI: `RMT_SYMBOL_LEVELS_MASK` while the line is high between two bytes
+    bool start_sent; //4B/5B + NRZI: the start delimiter was written
+    bool end_sent; //4B/5B + NRZI: the end delimiter was written
+} rmt_encoder_context_t;
+
+/**
+ * @brief This struct keeps track of a frame being decoded from received symbols, so the symbols can be fed to the
+ * decoder in chunks as the RMT driver hands them over (see `RMTCodec::decode_chunk`)
+ *
+ */
+typedef struct {
+    uint16_t symbol_duration; //shortest pulse (ticks) the symbols were sent with
+    LineCode line_code; //line code the symbols were sent with (picks the decoder in `decode_chunk`)
+    size_t output_index; //number of bytes decoded so far
+    uint16_t bits; //bits of the byte being decoded (Manchester) or code bits of the byte being decoded (4B/5B + NRZI), MSB first
+    uint8_t bit_count; //number of bits in `bits`
+    int8_t first_half; //Manchester: level of the first half of the bit being decoded (-1 if waiting for the first half)
+    bool started; //Manchester: the first pulse of the frame was decoded
+    uint8_t delimiter_bits; //4B/5B + NRZI: start delimiter bits left to skip
+    bool done; //the end marker was seen or the output is full (the rest of the frame is ignored)
+    bool failed; //an invalid pulse or code was seen (the rest of the frame is ignored)
+} rmt_decoder_context_t;
+
+/**
+ * @brief Line codes of the RMT channels: bytes -> RMT symbols (run by the RMT encoder) and captured symbols -> bytes.
+ * Only depends on the symbol word, not on the RMT driver, so it is also built (and unit tested) on the linux target
+ *
+ */
+class RMTCodec{
+    public:
+        static size_t encoder_callback(const void* data, size_t data_size, size_t symbols_written,
+            size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg);
+        static size_t encode_manchester(const uint8_t* bytes, size_t data_size, rmt_encoder_context_t* ctx, rmt_symbol_word_t* symbols, size_t symbols_free);
+        static size_t encode_4b5b_nrzi(const uint8_t* bytes, size_t data_size, rmt_encoder_context_t* ctx, rmt_symbol_word_t* symbols, size_t symbols_free);
+        static void reset_encoder_context(rmt_encoder_context_t* ctx);
+
+        static int decode_symbols(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, uint16_t symbol_duration,
+            LineCode line_code = LineCode::MANCHESTER);
+        static void decode_chunk(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx);
+        static int finish_decoding(uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx);
+        static void decode_manchester(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx);
+        static void decode_4b5b_nrzi(const rmt_symbol_word_t* symbols, size_t num, uint8_t* bytes, size_t output_num, rmt_decoder_context_t* ctx);
+        static void reset_decoder_context(rmt_decoder_context_t* ctx);
+};
+
+#endif //RMT_CODEC
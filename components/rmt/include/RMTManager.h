@@ -9,11 +9,16 @@
 #include "driver/rmt_tx.h"
 #include "driver/rmt_rx.h"
 #include "soc/gpio_num.h"
+#include "IPhysicalLayer.h"
+#include "RMTCodec.h"
 
-#define MAX_CHANNELS 4
 #define RMT_SYMBOL_BLOCK_SIZE 48
+#define RMT_DMA_SYMBOL_BLOCK_SIZE 1024 //size of the DMA buffer of a channel (in symbols) when DMA is used
 
-#define RECEIVE_BUFFER_SIZE 1024 //this is some value (we should probably set it to some packet size that we predetermine in some custom protocol:tm:)
+#define RMT_DEFAULT_MTU 128 //max bytes per transmission by default
+#define RMT_MAX_MTU PHY_MAX_MTU //the RX symbols are decoded in chunks, so the MTU only sizes the TX slots and decoded frames (6 * MTU bytes of internal RAM per channel)
+#define RMT_RX_CHUNK_SYMBOLS 128 //symbols of the RX buffer of a channel. Decoded every time it fills up (partial RX), so it does not grow with the MTU. Must be more than `RMT_SYMBOL_BLOCK_SIZE / 2`
+#define RECEIVE_WAIT_MS 150 //max time `receive` blocks waiting for a frame on a channel
 #define DEBUG_TAG "RMTManager"
 
 #define CHANNEL_LISTENING (0x2) //channel waiting to receive
@@ -22,49 +27,107 @@
 
 #define QUEUE_SIZE 10
 
+#define TX_QUEUE_DEPTH 4 //number of transmissions that can be queued in the RMT driver per channel (`trans_queue_depth`)
+
 #define MUTEX_MAX_WAIT_TICKS 100
+#define RMT_BIT_RATE_SWITCH_WAIT_MS 1000 //max time `set_bit_rate` and `set_line_code` wait for the queued transmissions to finish
+
+/**
+ * @brief Configuration of the RMT channels
+ *
+ */
+typedef struct {
+    size_t mtu; //max number of bytes in a single transmission (sizes the TX slots and decoded RX frames of every channel)
+    bool with_dma; //back the channels with DMA. Only one TX and one RX channel of the ESP32-S3 support DMA; the other channels fall back to non-DMA
+} rmt_manager_config_t;
+
+#define RMT_MANAGER_DEFAULT_CONFIG() { \
+    .mtu = RMT_DEFAULT_MTU, \
+    .with_dma = false, \
+}
 
 /**
- * @brief This struct keeps track of the current byte and bit index of the user data being transmmitted via RMT
+ * @brief Buffer holding the bytes of one transmission until the RMT driver is done with them
  *
  */
 typedef struct {
-    size_t byte_index; //which byte is currently being encoded when transmitting
-    uint8_t bit_index; //which bit in the `byte_index` is currently being encoded (into high/low waveforms)
-    size_t num_symbols; //temp
-} rmt_encoder_context_t;
+    uint8_t* data; //`mtu` bytes
+    size_t length;
+} TxSlot;
+
+/**
+ * @brief Fixed ring of TX slots of a channel. Transmissions complete in order, so the slots are handed out at
+ * `head` by the sending task and recycled at `tail` by the TX done callback
+ *
+ */
+typedef struct {
+    TxSlot slots[TX_QUEUE_DEPTH];
+    uint8_t head; //next slot to hand out (only modified by the sending task)
+    uint8_t tail; //oldest slot still owned by the RMT driver (only modified by the TX done callback)
+    bool acquired; //whether the slot at `head` has been handed out but not committed yet
+    SemaphoreHandle_t free_slots; //counting semaphore of the slots not owned by the RMT driver
+} TxSlotRing;
 
-//will need to keep the data alive until it has been transmitted (not working or being used atm)
 struct TxCallbackContext{
     SemaphoreHandle_t tx_done_sem;
-    QueueHandle_t transmit_queue;
+    TxSlotRing* slot_ring;
     rmt_encoder_context_t* tx_context;
-    QueueHandle_t free_mem_queue;
+};
+
+/**
+ * @brief State of a channel used by the encoder, TX done and RX done callbacks (run in the RMT ISR). Always in internal RAM
+ *
+ */
+/**
+ * @brief A frame decoded by the RX done callback
+ *
+ */
+typedef struct {
+    const uint8_t* data; //one of the `RxCallbackContext::frames`
+    int length; //number of decoded bytes (-1 if the frame failed to decode)
+} RxFrame;
+
+/**
+ * @brief State of the RX done callback of a channel. With partial RX the driver hands over the RX buffer every time it
+ * fills up and then receives into it again, so every chunk is decoded in the callback before it returns
+ *
+ */
+struct RxCallbackContext{
+    QueueHandle_t rx_queue; //`RxFrame` of every received frame
+    uint8_t* frames[2]; //ping-pong buffers (`mtu` bytes each) of the decoded frames (one is decoded into while the other one is copied out by `receive`)
+    uint8_t frame_index; //buffer the armed RX job decodes into
+    size_t mtu;
+    volatile LineCode line_code; //line code set by `set_line_code`, picked up at the start of the next frame
+    bool in_frame; //the first chunk of the frame being received was decoded
+    rmt_decoder_context_t decoder_context;
 };
 
 typedef struct {
-    uint8_t* data;
-    size_t length;
-} TxBuffer;
+    TxSlotRing tx_slots;
+    rmt_encoder_context_t encoder_context;
+    TxCallbackContext tx_context;
+    RxCallbackContext rx_context;
+} rmt_channel_isr_state;
 
 typedef struct _rmt_channel{
     //TX
     uint8_t tx_gpio;
     rmt_channel_handle_t tx_rmt_handle;
     SemaphoreHandle_t tx_done_semaphore;
-    QueueHandle_t tx_queue;
     rmt_encoder_handle_t encoder; //encoder config
-    rmt_encoder_context_t encoder_context;
-    TxCallbackContext tx_context;
+    rmt_channel_isr_state* isr; //TX slots, encoder and decoder state (internal RAM, see `alloc_channels`)
 
     //RX
     uint8_t rx_gpio;
     rmt_channel_handle_t rx_rmt_handle;
     QueueHandle_t rx_queue;
-    rmt_symbol_word_t raw_symbols[RECEIVE_BUFFER_SIZE]; //buffer to store the symbols on receive
-    rmt_symbol_word_t decoded_recv_symbols[RECEIVE_BUFFER_SIZE]; //allocating some dummy size buffer for decoded string
+    rmt_symbol_word_t* raw_symbols; //`RMT_RX_CHUNK_SYMBOLS` symbols the RMT driver receives into (decoded by `rmt_rx_done_callback`)
+    rmt_receive_config_t receive_config; //per channel as the glitch filter depends on the bit rate
+    uint16_t rx_symbol_duration; //half bit duration (ticks) the armed RX job and the decoder use
 
     //General
+    volatile uint16_t symbol_duration; //half bit duration (ticks) set by `set_bit_rate`. RX switches over on the next `receive`
+    volatile LineCode line_code; //line code set by `set_line_code`
     uint8_t status;
 } rmt_channel;
 
@@ -74,49 +137,61 @@ typedef struct _rmt_channel{
  * @author Justin Chow
  *
  */
-class RMTManager{
+class RMTManager : public IPhysicalLayer{
     public:
-        RMTManager(uint8_t num_channels);
-        ~RMTManager();
-        esp_err_t send(uint8_t* data, size_t size, rmt_transmit_config_t* config, uint8_t channel_num); //temp function to send some string data
-        esp_err_t receive(uint8_t* recv_buf, size_t size, size_t* output_size, uint8_t channel_num);
-
-        static size_t encoder_callback(const void* data, size_t data_size, size_t symbols_written,
-            size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg);
+        RMTManager(uint8_t num_channels, const rmt_manager_config_t& config = RMT_MANAGER_DEFAULT_CONFIG());
+        ~RMTManager() override;
+        esp_err_t send(const uint8_t* data, size_t size, uint8_t channel_num) override;
+        esp_err_t receive(uint8_t* recv_buf, size_t size, size_t* output_size, uint8_t channel_num) override;
+        esp_err_t acquire_tx_slot(uint8_t channel_num, uint8_t** buf, size_t* capacity) override;
+        esp_err_t commit_tx_slot(uint8_t channel_num, size_t size) override;
+        size_t get_mtu() const override;
+        uint32_t get_bit_rate(uint8_t channel_num) const override;
+        esp_err_t set_bit_rate(uint8_t channel_num, uint32_t bit_rate) override;
+        bool supports_bit_rate(LineCode line_code, uint32_t bit_rate) const override;
+        LineCode get_line_code(uint8_t channel_num) const override;
+        esp_err_t set_line_code(uint8_t channel_num, LineCode line_code) override;
 
         static bool rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data);
         static bool rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data);
 
-        esp_err_t start_receiving(uint8_t channel_num);
+        esp_err_t start_receiving(uint8_t channel_num) override;
 
-        esp_err_t wait_until_send_complete(uint8_t channel_num);
+        esp_err_t wait_until_send_complete(uint8_t channel_num) override;
 
     private:
         uint8_t num_channels; //number of channels initalized
+        rmt_manager_config_t config;
         esp_err_t init();
-        void reset_encoder_context(rmt_encoder_context_t* ctx);
         esp_err_t init_tx_channel();
         esp_err_t init_rx_channel();
-        int decode_symbols(rmt_symbol_word_t* symbols, size_t num, rmt_symbol_word_t* decoded, size_t output_num);
-        int convert_symbols_to_char(rmt_symbol_word_t* symbols, size_t num, uint8_t* string, size_t output_num);
+        esp_err_t alloc_channels();
+        void free_channels();
+        esp_err_t alloc_channel_buffers(uint8_t channel_num);
+        void free_channel_buffers(uint8_t channel_num);
+        esp_err_t apply_rx_bit_rate(uint8_t channel_num);
 
-        [[noreturn]] static void freeMemory(void* args);
-
-        rmt_channel channels[MAX_CHANNELS] = {0};
+        rmt_channel* channels = nullptr; //`num_channels` channels. Only touched by tasks, so they may be in PSRAM
         //=====================TX=====================
 
         // rmt_channel_handle_t tx_chan;
 
         const gpio_num_t tx_gpio[MAX_CHANNELS] = {GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_11, GPIO_NUM_13}; //using pins 4,5,11,13 for channels 0,1,2,3 respectively for tx
 
-        QueueHandle_t memory_to_free;
-
         //=====================RX=====================
         rmt_channel_handle_t rx_chan;
 
         const gpio_num_t rx_gpio[MAX_CHANNELS] = {GPIO_NUM_3, GPIO_NUM_6, GPIO_NUM_12, GPIO_NUM_14}; //using pins 3,6,12,14 for channels 0,1,2,3 respectively for rx
 
-        //rx_receive_config
+        //tx_transmit_config
+        rmt_transmit_config_t transmit_config = {
+            .loop_count = 0,
+            .flags = {
+                .eot_level = 0,
+            }
+        };
+
+        //rx_receive_config (template for `rmt_channel::receive_config`)
         rmt_receive_config_t receive_config = {
             .signal_range_min_ns = 200,
             .signal_range_max_ns = 200 * 1000,
@@ -1,19 +1,55 @@
-#ifdef RMT_COMMUNICATIONS
+#ifndef RMT_SYMBOLS
+#define RMT_SYMBOLS
 
-#include "driver/rmt_tx.h"
+#include <cstdint>
+#include "sdkconfig.h"
 
-#define RMT_RESOLUTION_HZ 4 * 1000 * 1000 // 4 MHz resolution
-#define RMT_DURATION_SYMBOL 2 //1 us
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Symbol word of the RMT peripheral (same layout as `hal/rmt_types.h`). The linux target has no RMT driver,
+ * but the line codes (`RMTCodec`) are built and tested there too
+ *
+ */
+typedef union {
+    struct {
+        uint16_t duration0 : 15;
+        uint16_t level0 : 1;
+        uint16_t duration1 : 15;
+        uint16_t level1 : 1;
+    };
+    uint32_t val;
+} rmt_symbol_word_t;
+#else
+#include "hal/rmt_types.h"
+#endif
+
+#define RMT_RESOLUTION_HZ (40 * 1000 * 1000) // 40 MHz resolution (25 ns ticks) so the symbol duration can be tuned per channel
+#define RMT_DURATION_SYMBOL 20 //default duration of half a bit (500 ns -> 1 Mbps). Can be changed per channel at runtime (see `RMTManager::set_bit_rate`)
+#define RMT_MIN_DURATION_SYMBOL 4 //shortest half bit (5 Mbps) that still leaves a tick of RX tolerance on either side
+#define RMT_MAX_DURATION_SYMBOL (8 * RMT_DURATION_SYMBOL) //longest half bit (125 kbps)
 
 #define RMT_DURATION_MAX (2 * RMT_DURATION_SYMBOL)
 
+#define RMT_BIT_RATE(duration) (RMT_RESOLUTION_HZ / (2 * (duration))) //bits per second with half bits of `duration` ticks
+#define RMT_DEFAULT_BIT_RATE RMT_BIT_RATE(RMT_DURATION_SYMBOL)
+
+#define RMT_SYMBOL_DURATIONS(duration) ((uint32_t)(duration) | ((uint32_t)(duration) << 16)) //`duration0` and `duration1` bits of a symbol word
+
+//RX tolerance window: a received pulse is one half bit if it is within [0.5, 1.5) symbol durations
+//and two half bits if it is within [1.5, 2.5) symbol durations (compared in half ticks to avoid rounding)
+#define RMT_RX_HALF_BIT_MIN_X2(duration) (duration)
+#define RMT_RX_HALF_BIT_MAX_X2(duration) (3 * (duration))
+#define RMT_RX_FULL_BIT_MAX_X2(duration) (5 * (duration))
+
+#define RMT_RX_GLITCH_NS(duration) ((uint32_t)((duration) * 400000000ULL / RMT_RESOLUTION_HZ)) //pulses shorter than 40% of a half bit are filtered out by the RX channel
+
 //MANCHESTER ENCODING (ETHERNET STANDARD)
 
 /**
  * @brief This struct represents a 1 symbol being transmitted over RMT. This will create a falling edge (low for `RMT_DURATION_SYMBOL` and high for `RMT_DURATION_SYMBOL`)
  * 
  */
-static const rmt_symbol_word_t RMT_SYMBOL_ONE = {
+static constexpr rmt_symbol_word_t RMT_SYMBOL_ONE = {
     .duration0 = RMT_DURATION_SYMBOL,
     .level0 = 1,
     .duration1 = RMT_DURATION_SYMBOL,
@@ -24,13 +60,146 @@ static const rmt_symbol_word_t RMT_SYMBOL_ONE = {
  * @brief This struct represents a 0 symbol being transmitted over RMT. This will create a rising edge (low for `RMT_DURATION_SYMBOL` and high for `RMT_DURATION_SYMBOL`)
  * 
  */
-static const rmt_symbol_word_t RMT_SYMBOL_ZERO = {
+static constexpr rmt_symbol_word_t RMT_SYMBOL_ZERO = {
     .duration0 = RMT_DURATION_SYMBOL,
     .level0 = 0,
     .duration1 = RMT_DURATION_SYMBOL,
     .level1 = 1,
 };
 
+#define RMT_BITS_PER_BYTE 8
+
+/**
+ * @brief Symbols used to encode every possible byte (MSB first) with Manchester encoding. Indexed by the byte value
+ *
+ */
+typedef struct {
+    rmt_symbol_word_t symbols[256][RMT_BITS_PER_BYTE];
+} rmt_manchester_table_t;
+
+/**
+ * @brief Builds the byte -> 8 symbol lookup table used by `RMTCodec::encoder_callback` (evaluated at compile time)
+ *
+ * @note Only the levels are stored (durations are 0). The encoder ORs in the symbol duration of the channel
+ * (`RMT_SYMBOL_DURATIONS`), so one table serves every bit rate
+ *
+ * @return constexpr rmt_manchester_table_t
+ */
+static constexpr rmt_manchester_table_t make_manchester_table(){
+    rmt_manchester_table_t table = {};
+    for (uint16_t byte = 0; byte < 256; byte++){
+        for (uint8_t bit_index = 0; bit_index < RMT_BITS_PER_BYTE; bit_index++){
+            bool bit = (byte >> (RMT_BITS_PER_BYTE - 1 - bit_index)) & 0x01; //MSB first
+            rmt_symbol_word_t symbol = bit ? RMT_SYMBOL_ONE : RMT_SYMBOL_ZERO;
+            symbol.duration0 = 0;
+            symbol.duration1 = 0;
+            table.symbols[byte][bit_index] = symbol;
+        }
+    }
+    return table;
+}
+
+//4B/5B + NRZI ENCODING
+
+//every nibble is sent as a 5 bit code (at most 3 zeros in a row), then every 1 code bit flips the line (NRZI).
+//Each code bit is one pulse of the symbol duration, so a byte is 10 pulses (5 symbol words) instead of 16 (8 symbol words)
+#define RMT_4B5B_CODE_BITS 5
+#define RMT_4B5B_INVALID_CODE 0xFF
+#define RMT_NRZI_SYMBOLS_PER_BYTE 5 //2 code bits per symbol word
+#define RMT_NRZI_DELIMITER_BITS 2 //code bits of the start (and end) delimiter
+#define RMT_NRZI_MAX_RUN_BITS 4 //longest pulse (in code bits): 3 zeros in a row after a 1
+
+#define RMT_4B5B_BIT_RATE(duration) ((uint32_t)(4ULL * RMT_RESOLUTION_HZ / (5 * (duration)))) //bits per second with code bits of `duration` ticks
+
+#define RMT_SYMBOL_LEVELS_MASK 0x80008000 //`level0` and `level1` bits of a symbol word
+
+/**
+ * @brief 5 bit code of every nibble (4B/5B data codes of FDDI/100BASE-TX)
+ *
+ */
+static constexpr uint8_t rmt_4b5b_codes[16] = {
+    0x1E, 0x09, 0x14, 0x15, 0x0A, 0x0B, 0x0E, 0x0F,
+    0x12, 0x13, 0x16, 0x17, 0x1A, 0x1B, 0x1C, 0x1D,
+};
+
+/**
+ * @brief Delimiter with code bits 11 starting from a low line (high for one code bit then low). Sent before the first
+ * byte so the receiver sees the first edge, and as the end delimiter if the line is low after the last byte
+ *
+ */
+static constexpr rmt_symbol_word_t RMT_NRZI_DELIMITER_FROM_LOW = {
+    .duration0 = 0,
+    .level0 = 1,
+    .duration1 = 0,
+    .level1 = 0,
+};
+
+/**
+ * @brief End delimiter with code bits 10 starting from a high line (brings the line back low)
+ *
+ */
+static constexpr rmt_symbol_word_t RMT_NRZI_DELIMITER_FROM_HIGH = {
+    .duration0 = 0,
+    .level0 = 0,
+    .duration1 = 0,
+    .level1 = 0,
+};
+
+/**
+ * @brief Symbols used to encode every possible byte (high nibble first) with 4B/5B + NRZI, starting from a low line.
+ * Indexed by the byte value
+ *
+ */
+typedef struct {
+    rmt_symbol_word_t symbols[256][RMT_NRZI_SYMBOLS_PER_BYTE];
+    bool ends_high[256]; //whether the line is left high (odd number of 1 code bits)
+} rmt_nrzi_table_t;
+
+/**
+ * @brief Builds the byte -> 5 symbol lookup table used by `RMTCodec::encode_4b5b_nrzi` (evaluated at compile time)
+ *
+ * @note Only the levels are stored (durations are 0). If the line is high before a byte, the encoder flips the levels
+ * (`RMT_SYMBOL_LEVELS_MASK`)
+ *
+ * @return constexpr rmt_nrzi_table_t
+ */
+static constexpr rmt_nrzi_table_t make_4b5b_nrzi_table(){
+    rmt_nrzi_table_t table = {};
+    for (uint16_t byte = 0; byte < 256; byte++){
+        uint16_t code = (rmt_4b5b_codes[byte >> 4] << RMT_4B5B_CODE_BITS) | rmt_4b5b_codes[byte & 0x0F];
+        uint8_t level = 0;
+        for (uint8_t i = 0; i < RMT_NRZI_SYMBOLS_PER_BYTE; i++){
+            rmt_symbol_word_t symbol = {};
+            level ^= (code >> (2 * RMT_4B5B_CODE_BITS - 1 - 2 * i)) & 0x01; //MSB first
+            symbol.level0 = level;
+            level ^= (code >> (2 * RMT_4B5B_CODE_BITS - 2 - 2 * i)) & 0x01;
+            symbol.level1 = level;
+            table.symbols[byte][i] = symbol;
+        }
+        table.ends_high[byte] = level;
+    }
+    return table;
+}
+
+/**
+ * @brief 5 bit code -> nibble (`RMT_4B5B_INVALID_CODE` for the 16 codes that are not data codes)
+ *
+ */
+typedef struct {
+    uint8_t nibbles[1 << RMT_4B5B_CODE_BITS];
+} rmt_4b5b_decode_table_t;
+
+static constexpr rmt_4b5b_decode_table_t make_4b5b_decode_table(){
+    rmt_4b5b_decode_table_t table = {};
+    for (uint8_t code = 0; code < (1 << RMT_4B5B_CODE_BITS); code++){
+        table.nibbles[code] = RMT_4B5B_INVALID_CODE;
+    }
+    for (uint8_t nibble = 0; nibble < 16; nibble++){
+        table.nibbles[rmt_4b5b_codes[nibble]] = nibble;
+    }
+    return table;
+}
+
 //not used at the moment
 
 // static const rmt_symbol_word_t RMT_SYMBOL_HIGH_STOP = {
@@ -47,4 +216,4 @@ static const rmt_symbol_word_t RMT_SYMBOL_ZERO = {
 //     .level1 = 1,
 // };
 
-#endif //RMT_COMMUNICATIONS
\ No newline at end of file
+#endif //RMT_SYMBOLS
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef VIRTUAL_WIRE_COMMUNICATIONS
+#define VIRTUAL_WIRE_COMMUNICATIONS
+
+#include <memory>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "IPhysicalLayer.h"
+
+#define VIRTUAL_WIRE_MAX_NODES 16 //max number of simulated boards sharing a single `VirtualWire`
+#define VIRTUAL_WIRE_MTU PHY_MAX_MTU //largest MTU a simulated link supports (same as `RMT_MAX_MTU`)
+#define VIRTUAL_WIRE_DEFAULT_MTU 128 //same as `RMT_DEFAULT_MTU`
+#define VIRTUAL_WIRE_DEFAULT_BIT_RATE 1000000 //same as `RMT_DEFAULT_BIT_RATE`
+#define VIRTUAL_WIRE_QUEUE_SIZE 10 //number of frames that can be in flight on one direction of a link
+#define VIRTUAL_WIRE_RX_WAIT_MS 150 //same receive timeout as `RMTManager::receive`
+#define VIRTUAL_WIRE_MUTEX_WAIT_MS 10
+
+#define VIRTUAL_WIRE_DEBUG_TAG "VirtualWire"
+
+/**
+ * @brief Byte stream travelling over a simulated wire. `data` is allocated by `VirtualWire::transmit` and freed once
+ * the frame is received (or the wire is destroyed)
+ *
+ */
+typedef struct {
+    uint8_t* data;
+    size_t length;
+} VirtualWireFrame;
+
+/**
+ * @brief The (node, channel) pair on the other end of a simulated wire
+ *
+ */
+typedef struct {
+    uint8_t node;
+    uint8_t channel;
+    bool connected;
+} VirtualWirePeer;
+
+/**
+ * @brief TX counters of one (node, channel) endpoint. Used to measure throughput per hop
+ *
+ */
+typedef struct {
+    uint32_t frames_tx;
+    uint32_t bytes_tx;
+    uint32_t frames_dropped; //transmitted on an unplugged channel, at a different bit rate than the peer or while the peer's RX queue was full
+    uint32_t frames_corrupted; //transmitted above the max bit rate of the endpoint (see `VirtualWire::set_max_bit_rate`)
+} VirtualWireStats;
+
+/**
+ * @brief In-process "wire" connecting the channels of N simulated boards by topology
+ *
+ * Each (node, channel) endpoint gets an RX queue once it is connected. Transmitting on an endpoint
+ * copies the bytes onto the RX queue of the peer endpoint, as if the TX pin was wired to the peer's RX pin.
+ *
+ * Each endpoint also has a bit rate and a line code. Frames sent at a different bit rate or with a different line code
+ * than the peer's are lost, and frames sent above the max bit rate of the endpoint (eg. a long cable) arrive with a
+ * flipped bit.
+ *
+ * @author Justin Chow
+ */
+class VirtualWire{
+    public:
+        explicit VirtualWire(uint8_t num_nodes);
+        ~VirtualWire();
+        esp_err_t connect(uint8_t node_a, uint8_t channel_a, uint8_t node_b, uint8_t channel_b);
+        esp_err_t transmit(uint8_t node, uint8_t channel, const uint8_t* data, size_t size);
+        esp_err_t receive(uint8_t node, uint8_t channel, uint8_t* buf, size_t size, size_t* length, TickType_t max_wait);
+        esp_err_t get_stats(uint8_t node, uint8_t channel, VirtualWireStats* stats);
+        esp_err_t set_bit_rate(uint8_t node, uint8_t channel, uint32_t bit_rate);
+        uint32_t get_bit_rate(uint8_t node, uint8_t channel);
+        esp_err_t set_max_bit_rate(uint8_t node, uint8_t channel, uint32_t max_bit_rate);
+        esp_err_t set_line_code(uint8_t node, uint8_t channel, LineCode line_code);
+        LineCode get_line_code(uint8_t node, uint8_t channel);
+
+    private:
+        uint8_t num_nodes;
+        SemaphoreHandle_t topology_mutex;
+        VirtualWirePeer peers[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {};
+        QueueHandle_t rx_queues[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {};
+        VirtualWireStats stats[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {};
+        uint32_t bit_rates[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {};
+        uint32_t max_bit_rates[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {}; //0 if the endpoint has no limit
+        LineCode line_codes[VIRTUAL_WIRE_MAX_NODES][MAX_CHANNELS] = {};
+
+        bool valid_endpoint(uint8_t node, uint8_t channel);
+};
+
+/**
+ * @brief Physical Layer of one simulated board attached to a `VirtualWire`
+ *
+ * Drop-in replacement for `RMTManager` (see `DataLinkManager(board_id, num_channels, phys_layer)`)
+ *
+ * @author Justin Chow
+ */
+class VirtualWireManager : public IPhysicalLayer{
+    public:
+        VirtualWireManager(std::shared_ptr<VirtualWire> wire, uint8_t node, uint8_t num_channels, size_t mtu = VIRTUAL_WIRE_DEFAULT_MTU);
+        ~VirtualWireManager() override = default;
+        esp_err_t send(const uint8_t* data, size_t size, uint8_t channel_num) override;
+        esp_err_t receive(uint8_t* recv_buf, size_t size, size_t* output_size, uint8_t channel_num) override;
+        esp_err_t acquire_tx_slot(uint8_t channel_num, uint8_t** buf, size_t* capacity) override;
+        esp_err_t commit_tx_slot(uint8_t channel_num, size_t size) override;
+        size_t get_mtu() const override;
+        uint32_t get_bit_rate(uint8_t channel_num) const override;
+        esp_err_t set_bit_rate(uint8_t channel_num, uint32_t bit_rate) override;
+        bool supports_bit_rate(LineCode line_code, uint32_t bit_rate) const override;
+        LineCode get_line_code(uint8_t channel_num) const override;
+        esp_err_t set_line_code(uint8_t channel_num, LineCode line_code) override;
+        esp_err_t start_receiving(uint8_t channel_num) override;
+        esp_err_t wait_until_send_complete(uint8_t channel_num) override;
+
+    private:
+        std::shared_ptr<VirtualWire> wire;
+        uint8_t node;
+        uint8_t num_channels;
+        size_t mtu;
+        std::unique_ptr<uint8_t[]> tx_slots[MAX_CHANNELS]; //`mtu` bytes each. The wire copies on transmit, so one slot per channel is enough
+        bool tx_slot_acquired[MAX_CHANNELS] = {};
+};
+
+#endif //VIRTUAL_WIRE_COMMUNICATIONS
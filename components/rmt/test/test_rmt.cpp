@@ -0,0 +1,388 @@
+#include "unity.h"
+#include "RMTCodec.h"
+#include "sdkconfig.h"
+#include "RMTSymbols.h"
+#include "VirtualWireManager.h"
+#include "esp_timer.h"
+#include <cstring>
+
+#define TEST_FRAME_SIZE 121 //a frame that fits the default 128 B MTU
+#define TEST_ENCODE_ITERATIONS 2000
+#define TEST_SYMBOL_BUFFER_SIZE (TEST_FRAME_SIZE * RMT_BITS_PER_BYTE)
+#define TEST_RMT_CHUNK_SIZE 64 //default `min_chunk_size` of the RMT simple encoder
+
+//the codec tests and benchmarks only use `RMTCodec` and run on both the ESP32-S3 and the linux target. Benchmark output
+//is prefixed with the target it was measured on (`CONFIG_IDF_TARGET`): host timings say nothing about the RMT ISR
+
+/**
+ * @brief Reference (one symbol per bit) encoder that `RMTCodec::encoder_callback` replaced
+ *
+ */
+static size_t bitwise_encoder_callback(const void* data, size_t data_size, size_t symbols_written,
+            size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg){
+    rmt_encoder_context_t* ctx = (rmt_encoder_context_t*) arg;
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t symbols_used = 0;
+    while (ctx->byte_index < data_size && symbols_used < symbols_free){
+        uint8_t bit = (bytes[ctx->byte_index] >> (7 - ctx->bit_index)) & 0x01;
+        symbols[symbols_used++] = bit ? RMT_SYMBOL_ONE : RMT_SYMBOL_ZERO;
+        ctx->num_symbols++;
+        ctx->bit_index++;
+        if (ctx->bit_index >= 8){
+            ctx->bit_index = 0;
+            ctx->byte_index++;
+        }
+    }
+    *done = (ctx->byte_index >= data_size);
+    return symbols_used;
+}
+
+typedef size_t (*encoder_fn)(const void*, size_t, size_t, size_t, rmt_symbol_word_t*, bool*, void*);
+
+/**
+ * @brief Runs `encoder` over `data` the same way the RMT driver does, giving it at most `chunk_size` free symbols per call
+ *
+ * @return size_t number of symbols written
+ */
+static size_t encode_in_chunks(encoder_fn encoder, const uint8_t* data, size_t data_size, size_t chunk_size, rmt_symbol_word_t* symbols, size_t symbols_size,
+            uint16_t symbol_duration = RMT_DURATION_SYMBOL, LineCode line_code = LineCode::MANCHESTER){
+    rmt_encoder_context_t ctx = {};
+    ctx.symbol_durations = RMT_SYMBOL_DURATIONS(symbol_duration);
+    ctx.line_code = line_code;
+    bool done = false;
+    size_t written = 0;
+    while (!done && written < symbols_size){
+        size_t free = (symbols_size - written) < chunk_size ? (symbols_size - written) : chunk_size;
+        written += encoder(data, data_size, written, free, &symbols[written], &done, &ctx);
+    }
+    return written;
+}
+
+static void fill_test_frame(uint8_t* frame, size_t size){
+    for (size_t i = 0; i < size; i++){
+        frame[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+}
+
+TEST_CASE("table encoder should match the bitwise encoder for any chunk size", "[rmt]"){
+    uint8_t frame[TEST_FRAME_SIZE];
+    fill_test_frame(frame, sizeof(frame));
+
+    static rmt_symbol_word_t expected[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t actual[TEST_SYMBOL_BUFFER_SIZE];
+
+    const size_t chunk_sizes[] = {1, 3, 7, 8, 13, 48, TEST_RMT_CHUNK_SIZE, TEST_SYMBOL_BUFFER_SIZE};
+    for (size_t chunk_size : chunk_sizes){
+        memset(actual, 0, sizeof(actual));
+        size_t expected_len = encode_in_chunks(bitwise_encoder_callback, frame, sizeof(frame), chunk_size, expected, TEST_SYMBOL_BUFFER_SIZE);
+        size_t actual_len = encode_in_chunks(RMTCodec::encoder_callback, frame, sizeof(frame), chunk_size, actual, TEST_SYMBOL_BUFFER_SIZE);
+
+        TEST_ASSERT_EQUAL(TEST_SYMBOL_BUFFER_SIZE, expected_len);
+        TEST_ASSERT_EQUAL(expected_len, actual_len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+    }
+}
+
+TEST_CASE("benchmark table encoder against the bitwise encoder", "[rmt][benchmark]"){
+    uint8_t frame[TEST_FRAME_SIZE];
+    fill_test_frame(frame, sizeof(frame));
+
+    static rmt_symbol_word_t symbols[TEST_SYMBOL_BUFFER_SIZE];
+
+    const encoder_fn encoders[] = {bitwise_encoder_callback, RMTCodec::encoder_callback};
+    const char* names[] = {"bitwise", "table"};
+
+    for (size_t i = 0; i < 2; i++){
+        int64_t start = esp_timer_get_time();
+        for (size_t n = 0; n < TEST_ENCODE_ITERATIONS; n++){
+            encode_in_chunks(encoders[i], frame, sizeof(frame), TEST_RMT_CHUNK_SIZE, symbols, TEST_SYMBOL_BUFFER_SIZE);
+        }
+        int64_t elapsed_us = esp_timer_get_time() - start;
+        printf("[%s] %s encoder: %d B in %lld us (%.2f B/us)\n", CONFIG_IDF_TARGET, names[i], TEST_FRAME_SIZE * TEST_ENCODE_ITERATIONS, elapsed_us,
+            (double)(TEST_FRAME_SIZE * TEST_ENCODE_ITERATIONS) / elapsed_us);
+    }
+}
+
+/**
+ * @brief Turns transmitted symbols into what the RMT RX channel captures: runs of the same level are merged into
+ * one pulse, the leading low (idle line) is not seen and the trailing low is the end marker (duration 0).
+ * Every other pulse is shortened by one tick to emulate edge jitter
+ *
+ * @return size_t number of captured symbols
+ */
+static size_t capture_symbols(const rmt_symbol_word_t* tx, size_t tx_num, rmt_symbol_word_t* rx, size_t rx_size){
+    uint8_t levels[TEST_SYMBOL_BUFFER_SIZE * 2];
+    uint16_t durations[TEST_SYMBOL_BUFFER_SIZE * 2];
+    size_t num_pulses = 0;
+
+    for (size_t i = 0; i < tx_num; i++){
+        const uint8_t halves_level[2] = {(uint8_t)tx[i].level0, (uint8_t)tx[i].level1};
+        const uint16_t halves_duration[2] = {(uint16_t)tx[i].duration0, (uint16_t)tx[i].duration1};
+        for (uint8_t h = 0; h < 2; h++){
+            if (num_pulses == 0 && halves_level[h] == 0){
+                continue; //idle line is low
+            }
+            if (num_pulses > 0 && levels[num_pulses - 1] == halves_level[h]){
+                durations[num_pulses - 1] += halves_duration[h];
+            } else {
+                levels[num_pulses] = halves_level[h];
+                durations[num_pulses] = halves_duration[h];
+                num_pulses++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_pulses; i += 2){
+        durations[i] -= (i / 2) % 2;
+    }
+
+    if (levels[num_pulses - 1] == 0){
+        durations[num_pulses - 1] = 0; //trailing low becomes the end marker
+    } else {
+        levels[num_pulses] = 0;
+        durations[num_pulses] = 0;
+        num_pulses++;
+    }
+
+    size_t rx_num = 0;
+    for (size_t i = 0; i < num_pulses && rx_num < rx_size; i += 2){
+        rx[rx_num].level0 = levels[i];
+        rx[rx_num].duration0 = durations[i];
+        rx[rx_num].level1 = i + 1 < num_pulses ? levels[i + 1] : 0;
+        rx[rx_num].duration1 = i + 1 < num_pulses ? durations[i + 1] : 0;
+        rx_num++;
+    }
+    return rx_num;
+}
+
+TEST_CASE("decoder should recover the encoded bytes from jittered captures", "[rmt]"){
+    static uint8_t frame[TEST_FRAME_SIZE];
+    static rmt_symbol_word_t tx[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t rx[TEST_SYMBOL_BUFFER_SIZE];
+    uint8_t decoded[TEST_FRAME_SIZE];
+
+    //a frame cannot start with two 0 bits (see `RMTCodec::decode_symbols`) - frames start with the preamble
+    const uint8_t first_bytes[] = {0x40, 0x7F, 0x80, 0xFF, 0xAB};
+    const uint8_t last_bytes[] = {0x00, 0x01, 0x80, 0xFF, 0xAB};
+    const uint16_t symbol_durations[] = {RMT_MAX_DURATION_SYMBOL, RMT_DURATION_SYMBOL, RMT_MIN_DURATION_SYMBOL};
+    for (uint16_t symbol_duration : symbol_durations){
+        for (uint8_t first : first_bytes){
+            for (uint8_t last : last_bytes){
+                fill_test_frame(frame, sizeof(frame));
+                frame[0] = first;
+                frame[sizeof(frame) - 1] = last;
+
+                size_t tx_num = encode_in_chunks(RMTCodec::encoder_callback, frame, sizeof(frame), TEST_RMT_CHUNK_SIZE, tx, TEST_SYMBOL_BUFFER_SIZE, symbol_duration);
+                size_t rx_num = capture_symbols(tx, tx_num, rx, TEST_SYMBOL_BUFFER_SIZE);
+
+                memset(decoded, 0, sizeof(decoded));
+                int num = RMTCodec::decode_symbols(rx, rx_num, decoded, sizeof(decoded), symbol_duration);
+
+                TEST_ASSERT_EQUAL(TEST_FRAME_SIZE, num);
+                TEST_ASSERT_EQUAL_MEMORY(frame, decoded, sizeof(frame));
+            }
+        }
+    }
+}
+
+TEST_CASE("decoder should reject pulses outside of the tolerance window", "[rmt]"){
+    uint8_t decoded[4];
+    rmt_symbol_word_t glitch[] = {
+        {.duration0 = RMT_DURATION_SYMBOL, .level0 = 1, .duration1 = 3 * RMT_DURATION_SYMBOL, .level1 = 0},
+        {.duration0 = 0, .level0 = 0, .duration1 = 0, .level1 = 0},
+    };
+    TEST_ASSERT_EQUAL(ESP_FAIL, RMTCodec::decode_symbols(glitch, 2, decoded, sizeof(decoded), RMT_DURATION_SYMBOL));
+}
+
+TEST_CASE("4B/5B NRZI decoder should recover every byte value for any chunk size", "[rmt]"){
+    static uint8_t frame[TEST_FRAME_SIZE];
+    static rmt_symbol_word_t tx[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t expected[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t rx[TEST_SYMBOL_BUFFER_SIZE];
+    uint8_t decoded[TEST_FRAME_SIZE];
+
+    const uint16_t symbol_durations[] = {RMT_MAX_DURATION_SYMBOL, RMT_DURATION_SYMBOL, RMT_MIN_DURATION_SYMBOL};
+    const size_t frame_sizes[] = {1, 2, TEST_FRAME_SIZE};
+    const size_t chunk_sizes[] = {1, 3, 5, 7, 48, TEST_RMT_CHUNK_SIZE};
+    for (uint16_t symbol_duration : symbol_durations){
+        for (size_t first = 0; first < 256; first += TEST_FRAME_SIZE){
+            for (size_t frame_size : frame_sizes){
+                for (size_t i = 0; i < frame_size; i++){
+                    frame[i] = static_cast<uint8_t>(first + i);
+                }
+
+                size_t expected_len = encode_in_chunks(RMTCodec::encoder_callback, frame, frame_size, TEST_SYMBOL_BUFFER_SIZE, expected,
+                    TEST_SYMBOL_BUFFER_SIZE, symbol_duration, LineCode::NRZI_4B5B);
+                TEST_ASSERT_EQUAL(RMT_NRZI_SYMBOLS_PER_BYTE * frame_size + 2, expected_len); //+ start and end delimiters
+
+                for (size_t chunk_size : chunk_sizes){
+                    size_t tx_num = encode_in_chunks(RMTCodec::encoder_callback, frame, frame_size, chunk_size, tx, TEST_SYMBOL_BUFFER_SIZE,
+                        symbol_duration, LineCode::NRZI_4B5B);
+                    TEST_ASSERT_EQUAL(expected_len, tx_num);
+                    TEST_ASSERT_EQUAL_MEMORY(expected, tx, tx_num * sizeof(rmt_symbol_word_t));
+                }
+
+                size_t rx_num = capture_symbols(expected, expected_len, rx, TEST_SYMBOL_BUFFER_SIZE);
+                memset(decoded, 0, sizeof(decoded));
+                int num = RMTCodec::decode_symbols(rx, rx_num, decoded, sizeof(decoded), symbol_duration, LineCode::NRZI_4B5B);
+
+                TEST_ASSERT_EQUAL(frame_size, num);
+                TEST_ASSERT_EQUAL_MEMORY(frame, decoded, frame_size);
+            }
+        }
+    }
+}
+
+TEST_CASE("4B/5B NRZI decoder should reject invalid codes", "[rmt]"){
+    uint8_t decoded[4];
+    //every bit a 1: the start delimiter followed by 11111 11111, which is not a 4B/5B code
+    rmt_symbol_word_t ones[7] = {};
+    for (size_t i = 0; i < 6; i++){
+        ones[i] = {.duration0 = RMT_DURATION_SYMBOL, .level0 = 1, .duration1 = RMT_DURATION_SYMBOL, .level1 = 0};
+    }
+    TEST_ASSERT_EQUAL(ESP_FAIL, RMTCodec::decode_symbols(ones, 7, decoded, sizeof(decoded), RMT_DURATION_SYMBOL, LineCode::NRZI_4B5B));
+}
+
+TEST_CASE("decoder should give the same bytes when the symbols arrive in chunks", "[rmt]"){
+    static uint8_t frame[TEST_FRAME_SIZE];
+    static rmt_symbol_word_t tx[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t rx[TEST_SYMBOL_BUFFER_SIZE];
+    uint8_t decoded[TEST_FRAME_SIZE];
+
+    //chunk sizes include the ones the RMT driver hands over with partial RX (`RMT_SYMBOL_BLOCK_SIZE / 2` without DMA)
+    const size_t chunk_sizes[] = {1, 2, 7, 24, TEST_RMT_CHUNK_SIZE, TEST_SYMBOL_BUFFER_SIZE};
+    const LineCode line_codes[] = {LineCode::MANCHESTER, LineCode::NRZI_4B5B};
+    const uint8_t last_bytes[] = {0x00, 0x01, 0xFF};
+    for (LineCode line_code : line_codes){
+        for (uint8_t last : last_bytes){
+            fill_test_frame(frame, sizeof(frame));
+            frame[0] = 0xAB;
+            frame[sizeof(frame) - 1] = last;
+
+            size_t tx_num = encode_in_chunks(RMTCodec::encoder_callback, frame, sizeof(frame), TEST_RMT_CHUNK_SIZE, tx, TEST_SYMBOL_BUFFER_SIZE,
+                RMT_DURATION_SYMBOL, line_code);
+            size_t rx_num = capture_symbols(tx, tx_num, rx, TEST_SYMBOL_BUFFER_SIZE);
+
+            for (size_t chunk_size : chunk_sizes){
+                rmt_decoder_context_t ctx;
+                RMTCodec::reset_decoder_context(&ctx);
+                ctx.symbol_duration = RMT_DURATION_SYMBOL;
+                ctx.line_code = line_code;
+
+                memset(decoded, 0, sizeof(decoded));
+                for (size_t i = 0; i < rx_num; i += chunk_size){
+                    size_t num = (rx_num - i) < chunk_size ? (rx_num - i) : chunk_size;
+                    RMTCodec::decode_chunk(&rx[i], num, decoded, sizeof(decoded), &ctx);
+                }
+                int num = RMTCodec::finish_decoding(decoded, sizeof(decoded), &ctx);
+
+                TEST_ASSERT_EQUAL(TEST_FRAME_SIZE, num);
+                TEST_ASSERT_EQUAL_MEMORY(frame, decoded, sizeof(frame));
+            }
+        }
+    }
+}
+
+TEST_CASE("decoder should drop the whole frame when a later chunk has an invalid pulse", "[rmt]"){
+    uint8_t decoded[4];
+    const rmt_symbol_word_t one = {.duration0 = RMT_DURATION_SYMBOL, .level0 = 1, .duration1 = RMT_DURATION_SYMBOL, .level1 = 0};
+    const rmt_symbol_word_t glitch = {.duration0 = RMT_DURATION_SYMBOL, .level0 = 1, .duration1 = 3 * RMT_DURATION_SYMBOL, .level1 = 0};
+    const rmt_symbol_word_t end = {.duration0 = 0, .level0 = 0, .duration1 = 0, .level1 = 0};
+
+    rmt_decoder_context_t ctx;
+    RMTCodec::reset_decoder_context(&ctx);
+    ctx.symbol_duration = RMT_DURATION_SYMBOL;
+    ctx.line_code = LineCode::MANCHESTER;
+    RMTCodec::decode_chunk(&one, 1, decoded, sizeof(decoded), &ctx);
+    RMTCodec::decode_chunk(&glitch, 1, decoded, sizeof(decoded), &ctx);
+    RMTCodec::decode_chunk(&end, 1, decoded, sizeof(decoded), &ctx);
+    TEST_ASSERT_EQUAL(ESP_FAIL, RMTCodec::finish_decoding(decoded, sizeof(decoded), &ctx));
+}
+
+TEST_CASE("benchmark symbols per byte of each line code", "[rmt][benchmark]"){
+    static uint8_t frame[TEST_FRAME_SIZE];
+    static rmt_symbol_word_t tx[TEST_SYMBOL_BUFFER_SIZE];
+    static rmt_symbol_word_t rx[TEST_SYMBOL_BUFFER_SIZE];
+    fill_test_frame(frame, sizeof(frame));
+    frame[0] = 0xAB; //preamble
+
+    const LineCode line_codes[] = {LineCode::MANCHESTER, LineCode::NRZI_4B5B};
+    const char* names[] = {"manchester", "4b5b nrzi"};
+
+    for (size_t i = 0; i < 2; i++){
+        size_t tx_num = encode_in_chunks(RMTCodec::encoder_callback, frame, sizeof(frame), TEST_RMT_CHUNK_SIZE, tx, TEST_SYMBOL_BUFFER_SIZE,
+            RMT_DURATION_SYMBOL, line_codes[i]);
+        size_t rx_num = capture_symbols(tx, tx_num, rx, TEST_SYMBOL_BUFFER_SIZE);
+
+        uint64_t wire_ticks = 0;
+        for (size_t n = 0; n < tx_num; n++){
+            wire_ticks += tx[n].duration0 + tx[n].duration1;
+        }
+        printf("[%s] %s: %d B -> %d TX / %d RX symbol words (%.2f / %.2f per byte), %llu ns on the wire\n", CONFIG_IDF_TARGET, names[i], TEST_FRAME_SIZE,
+            (int)tx_num, (int)rx_num, (double)tx_num / TEST_FRAME_SIZE, (double)rx_num / TEST_FRAME_SIZE,
+            (unsigned long long)(wire_ticks * 1000000000ULL / RMT_RESOLUTION_HZ));
+    }
+
+    size_t nrzi_num = encode_in_chunks(RMTCodec::encoder_callback, frame, sizeof(frame), TEST_RMT_CHUNK_SIZE, tx, TEST_SYMBOL_BUFFER_SIZE,
+        RMT_DURATION_SYMBOL, LineCode::NRZI_4B5B);
+    TEST_ASSERT_EQUAL(RMT_NRZI_SYMBOLS_PER_BYTE * TEST_FRAME_SIZE + 2, nrzi_num);
+}
+
+TEST_CASE("tx slots should be transmitted on commit and given back on an empty commit", "[rmt]"){
+    auto wire = std::make_shared<VirtualWire>(2);
+    TEST_ASSERT_EQUAL(ESP_OK, wire->connect(0, 0, 1, 0));
+    VirtualWireManager a(wire, 0, 1);
+    VirtualWireManager b(wire, 1, 1);
+
+    uint8_t* slot = nullptr;
+    size_t capacity = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, a.acquire_tx_slot(0, &slot, &capacity));
+    TEST_ASSERT_NOT_NULL(slot);
+    TEST_ASSERT_GREATER_OR_EQUAL(TEST_FRAME_SIZE, capacity);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, a.acquire_tx_slot(0, &slot, &capacity));
+
+    fill_test_frame(slot, TEST_FRAME_SIZE);
+    TEST_ASSERT_EQUAL(ESP_OK, a.commit_tx_slot(0, TEST_FRAME_SIZE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, a.commit_tx_slot(0, TEST_FRAME_SIZE));
+
+    uint8_t expected[TEST_FRAME_SIZE];
+    uint8_t received[TEST_FRAME_SIZE];
+    size_t received_size = 0;
+    fill_test_frame(expected, sizeof(expected));
+    TEST_ASSERT_EQUAL(ESP_OK, b.receive(received, sizeof(received), &received_size, 0));
+    TEST_ASSERT_EQUAL(TEST_FRAME_SIZE, received_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, received, sizeof(expected));
+
+    //empty commit gives the slot back without transmitting
+    TEST_ASSERT_EQUAL(ESP_OK, a.acquire_tx_slot(0, &slot, &capacity));
+    TEST_ASSERT_EQUAL(ESP_OK, a.commit_tx_slot(0, 0));
+    VirtualWireStats stats;
+    TEST_ASSERT_EQUAL(ESP_OK, wire->get_stats(0, 0, &stats));
+    TEST_ASSERT_EQUAL(1, stats.frames_tx);
+}
+
+TEST_CASE("should only transmit up to the configured MTU", "[rmt]"){
+    auto wire = std::make_shared<VirtualWire>(2);
+    TEST_ASSERT_EQUAL(ESP_OK, wire->connect(0, 0, 1, 0));
+    VirtualWireManager a(wire, 0, 1, VIRTUAL_WIRE_MTU);
+    VirtualWireManager b(wire, 1, 1, VIRTUAL_WIRE_MTU);
+    TEST_ASSERT_EQUAL(VIRTUAL_WIRE_MTU, a.get_mtu());
+
+    uint8_t* slot = nullptr;
+    size_t capacity = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, a.acquire_tx_slot(0, &slot, &capacity));
+    TEST_ASSERT_EQUAL(VIRTUAL_WIRE_MTU, capacity);
+    fill_test_frame(slot, capacity);
+    TEST_ASSERT_EQUAL(ESP_OK, a.commit_tx_slot(0, capacity));
+
+    static uint8_t expected[VIRTUAL_WIRE_MTU];
+    static uint8_t received[VIRTUAL_WIRE_MTU];
+    size_t received_size = 0;
+    fill_test_frame(expected, sizeof(expected));
+    TEST_ASSERT_EQUAL(ESP_OK, b.receive(received, sizeof(received), &received_size, 0));
+    TEST_ASSERT_EQUAL(VIRTUAL_WIRE_MTU, received_size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, received, sizeof(expected));
+
+    VirtualWireManager small(wire, 0, 1, TEST_FRAME_SIZE);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, small.send(expected, TEST_FRAME_SIZE + 1, 0));
+}
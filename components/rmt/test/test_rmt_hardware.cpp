@@ -0,0 +1,19 @@
+//Tests that need the RMT peripheral (ESP32-S3 only). Not built for the linux target (see `CMakeLists.txt`)
+#include "unity.h"
+#include "RMTManager.h"
+#include "esp_heap_caps.h"
+
+#define TEST_RMT_MAX_CHANNEL_RAM 4096 //internal RAM a channel may take with the default MTU (MTU sized RX symbol buffers alone took 8200 B)
+
+TEST_CASE("should only take internal RAM for the channels in use", "[rmt][hardware]"){
+    const rmt_manager_config_t config = RMT_MANAGER_DEFAULT_CONFIG();
+    const size_t rx_buffers_size = RMT_RX_CHUNK_SYMBOLS * sizeof(rmt_symbol_word_t) + 2 * config.mtu; //RX chunk + decoded frames
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    RMTManager rmt(1, config);
+    size_t used = free_before - heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    printf("1 channel (MTU %d B): %d B of internal RAM\n", (int)config.mtu, (int)used);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(rx_buffers_size, used);
+    TEST_ASSERT_LESS_THAN(TEST_RMT_MAX_CHANNEL_RAM, used); //also fails if the buffers of a second channel were allocated
+}
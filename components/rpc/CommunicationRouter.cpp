@@ -9,6 +9,7 @@
 #include "PtrQueue.h"
 #include "Tables.h"
 #include "constants/module.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
@@ -18,6 +19,20 @@
 #define TAG "CommunicationRouter"
 #define MAX_RX_BUFFER_SIZE 1024
 #define WIRELESS_DEQUEUE_TIMEOUT_MS 3000
+#define MPI_CONTROL_DEADLINE_US 50000 // non durable messages still queued on the link after this are stale and dropped
+
+// Sends an MPI message over the data link. Non durable messages get a deadline and are coalesced by destination and
+// tag, so a newer command replaces one still waiting to be sent instead of queueing behind it.
+static void send_on_data_link(DataLinkManager &data_link_manager, const uint8_t dest,
+                              std::unique_ptr<std::vector<uint8_t>> &&buffer, const Messaging::MPIMessage *mpi_message) {
+    int64_t deadline_us = 0;
+    uint32_t coalesce_key = 0;
+    if (!mpi_message->is_durable()) {
+        deadline_us = esp_timer_get_time() + MPI_CONTROL_DEADLINE_US;
+        coalesce_key = 1u << 16 | static_cast<uint32_t>(dest) << 8 | mpi_message->tag(); // non zero for any dest/tag
+    }
+    data_link_manager.send(dest, std::move(buffer), FrameType::MOTOR_TYPE, 0, deadline_us, coalesce_key);
+}
 
 CommunicationRouter::~CommunicationRouter() {
     vTaskDelete(m_router_thread);
@@ -121,7 +136,7 @@ void CommunicationRouter::route(uint8_t *buffer, size_t size) const {
         u_buffer->resize(size);
         memcpy(u_buffer->data(), buffer, size);
 
-        this->m_data_link_manager->send(dest, std::move(u_buffer), FrameType::MOTOR_TYPE, 0);
+        send_on_data_link(*this->m_data_link_manager, dest, std::move(u_buffer), mpi_message);
     }
 }
 
@@ -144,10 +159,9 @@ void CommunicationRouter::route(std::unique_ptr<std::vector<uint8_t>>&& buffer)
             this->m_lossy_server->send_msg(buffer->data(), buffer->size());
         }
     } else if (mpi_message->destination() == PC_ADDR) {
-        this->m_data_link_manager->send(this->m_leader, std::move(buffer), FrameType::MOTOR_TYPE, 0);
+        send_on_data_link(*this->m_data_link_manager, this->m_leader, std::move(buffer), mpi_message);
     } else {
-        this->m_data_link_manager->send(mpi_message->destination(), std::move(buffer), FrameType::MOTOR_TYPE,
-                                        0);
+        send_on_data_link(*this->m_data_link_manager, mpi_message->destination(), std::move(buffer), mpi_message);
     }
 }
 
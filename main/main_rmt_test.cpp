@@ -19,6 +19,7 @@
 #include "esp_log.h"
 
 #define DATA_SIZE_TEST 600
+#define TEST_MAX_BOARDS 10 //boards in the demo network (the RIP table has a row for every board id)
 
 //current board id
 #ifdef SRC_BOARD
@@ -147,10 +148,10 @@ void multi_transceiver(void* arg) {
     uint32_t num_incorrect = 0;
     uint32_t total_transactions = 0;
 
-    RIPRow_public_matrix matrix[RIP_MAX_ROUTES];
-    size_t matrix_size = RIP_MAX_ROUTES;
+    RIPRow_public_matrix matrix[TEST_MAX_BOARDS];
+    size_t matrix_size = TEST_MAX_BOARDS;
 
-    for (int i = 0; i < RIP_MAX_ROUTES; i++){
+    for (int i = 0; i < TEST_MAX_BOARDS; i++){
         RIPRow_public* table = (RIPRow_public*)pvPortMalloc(sizeof(RIPRow_public)*RIP_MAX_ROUTES);
         matrix[i] = {
             .table = table,